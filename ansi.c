@@ -1,14 +1,53 @@
 #include "ansi.h"
-#include <stdio.h>
-
-// Use Z88DK's built-in putchar - no need for custom implementation
-
-// Helper function to print a number as decimal
-void print_num(int num) {
-    if (num >= 10) {
-        print_num(num / 10);
-    }
-    putchar('0' + (num % 10));
+#include "console.h"
+
+// Output goes through the buffered console, in order with printStr()
+
+// Fixed sequences, each written as one block
+#define ESC "\033"
+#define ANSI_DA           ESC "[c"
+#define ANSI_CPR          ESC "[6n"
+#define ANSI_CLEAR_SCREEN ESC "[2J"
+#define ANSI_HOME         ESC "[H"
+#define ANSI_CLEAR_EOL    ESC "[K"
+#define ANSI_RESET        ESC "[m"     // Parameter 0 is the default
+#define ANSI_BOLD         ESC "[1m"
+#define ANSI_DIM          ESC "[2m"
+#define ANSI_UNDERLINE    ESC "[4m"
+#define ANSI_SAVE         ESC "[s"
+#define ANSI_RESTORE      ESC "[u"
+#define ANSI_HIDE_CURSOR  ESC "[?25l"
+#define ANSI_SHOW_CURSOR  ESC "[?25h"
+
+// Colour templates - the colour digit is patched in before writing
+char ansi_fg_normal[] = ESC "[30m";
+char ansi_fg_bright[] = ESC "[1;30m";
+char ansi_bg_normal[] = ESC "[40m";
+char ansi_bg_bright[] = ESC "[100m";
+#define FG_NORMAL_DIGIT 3
+#define FG_BRIGHT_DIGIT 5
+#define BG_NORMAL_DIGIT 3
+#define BG_BRIGHT_DIGIT 4
+
+// Sequence builder for the numeric sequences: ESC [ n ; n X
+char ansi_seq[12] = ESC "[";
+unsigned char ansi_seq_len;
+
+// Append a decimal number (0-999) to ansi_seq
+void ansi_seq_num(int num) {
+    if (num < 0) num = 0;
+    if (num >= 100) ansi_seq[ansi_seq_len++] = '0' + num / 100;
+    if (num >= 10) ansi_seq[ansi_seq_len++] = '0' + (num / 10) % 10;
+    ansi_seq[ansi_seq_len++] = '0' + num % 10;
+}
+
+// Write ESC [ num final as one block
+void ansi_write_num(int num, char final) {
+    ansi_seq_len = 2;
+    ansi_seq_num(num);
+    ansi_seq[ansi_seq_len++] = final;
+    ansi_seq[ansi_seq_len] = '\0';
+    printStr(ansi_seq);
 }
 
 ansi_capability_t g_ansi_capability = ANSI_UNKNOWN;
@@ -16,9 +55,7 @@ ansi_capability_t g_ansi_capability = ANSI_UNKNOWN;
 // Send ANSI escape code for Device Attributes (DA) and read response
 int ansi_test_device_attributes(void) {
     // Send DA escape code: ESC [ c
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('c');
+    printStr(ANSI_DA);
     
     // Implement response reading (stub)
     // Normally, read from serial or input buffer and check for expected response
@@ -28,10 +65,7 @@ int ansi_test_device_attributes(void) {
 // Send ANSI escape code for Cursor Position Report (CPR) and read response
 int ansi_test_cursor_position_report(void) {
     // Send CPR escape code: ESC [ 6 n
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('6');
-    putchar('n');
+    printStr(ANSI_CPR);
     
     // Implement response reading (stub)
     // Normally, read from serial or input buffer and check for expected response
@@ -57,164 +91,105 @@ ansi_capability_t ansi_detect_capability(void) {
 }
 
 void ansi_clear_screen(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('2');
-    putchar('J');
+    printStr(ANSI_CLEAR_SCREEN);
 }
 
 void ansi_home_cursor(void) {
-    putchar(27);
-    putchar('[');
-    putchar('H');
+    printStr(ANSI_HOME);
 }
 
 void ansi_goto_xy(int x, int y) {
-    putchar(27);  // ESC
-    putchar('[');
-    print_num(y);
-    putchar(';');
-    print_num(x);
-    putchar('H');
+    ansi_seq_len = 2;
+    ansi_seq_num(y);
+    ansi_seq[ansi_seq_len++] = ';';
+    ansi_seq_num(x);
+    ansi_seq[ansi_seq_len++] = 'H';
+    ansi_seq[ansi_seq_len] = '\0';
+    printStr(ansi_seq);
 }
 
 void ansi_clear_line(void) {
-    putchar(27);
-    putchar('[');
-    putchar('K');
+    printStr(ANSI_CLEAR_EOL);
 }
 
 void ansi_clear_to_eol(void) {
-    putchar(27);
-    putchar('[');
-    putchar('K');
+    printStr(ANSI_CLEAR_EOL);
 }
 
 void ansi_set_fg_color(ansi_color_t color) {
-    putchar(27);  // ESC
-    putchar('[');
-    
     if (color >= 8) {
         // Bright colors: ESC[1;3Xm format
-        putchar('1');
-        putchar(';');
-        putchar('3');
-        putchar('0' + (color - 8));
+        ansi_fg_bright[FG_BRIGHT_DIGIT] = '0' + (color - 8);
+        printStr(ansi_fg_bright);
     } else {
         // Normal colors: ESC[3Xm format (30-37)
-        putchar('3');
-        putchar('0' + color);
+        ansi_fg_normal[FG_NORMAL_DIGIT] = '0' + color;
+        printStr(ansi_fg_normal);
     }
-    putchar('m');
 }
 
 void ansi_set_bg_color(ansi_color_t color) {
-    putchar(27);  // ESC
-    putchar('[');
     if (color >= 8) {
         // Bright background colors (8-15): use ESC[10Xm format
-        putchar('1');
-        putchar('0');
-        putchar('0' + (color - 8));
+        ansi_bg_bright[BG_BRIGHT_DIGIT] = '0' + (color - 8);
+        printStr(ansi_bg_bright);
     } else {
         // Normal background colors (0-7): use ESC[4Xm format (40-47)
-        putchar('4');
-        putchar('0' + color);
+        ansi_bg_normal[BG_NORMAL_DIGIT] = '0' + color;
+        printStr(ansi_bg_normal);
     }
-    putchar('m');
 }
 
 void ansi_reset_colors(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('0');
-    putchar('m');
+    printStr(ANSI_RESET);
 }
 
 void ansi_set_bold(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('1');
-    putchar('m');
+    printStr(ANSI_BOLD);
 }
 
 void ansi_set_dim(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('2');
-    putchar('m');
+    printStr(ANSI_DIM);
 }
 
 void ansi_set_underline(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('4');
-    putchar('m');
+    printStr(ANSI_UNDERLINE);
 }
 
 void ansi_reset_attributes(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('0');
-    putchar('m');
+    printStr(ANSI_RESET);
 }
 
 void ansi_cursor_up(int lines) {
-    putchar(27);  // ESC
-    putchar('[');
-    print_num(lines);
-    putchar('A');
+    ansi_write_num(lines, 'A');
 }
 
 void ansi_cursor_down(int lines) {
-    putchar(27);  // ESC
-    putchar('[');
-    print_num(lines);
-    putchar('B');
+    ansi_write_num(lines, 'B');
 }
 
 void ansi_cursor_right(int cols) {
-    putchar(27);  // ESC
-    putchar('[');
-    print_num(cols);
-    putchar('C');
+    ansi_write_num(cols, 'C');
 }
 
 void ansi_cursor_left(int cols) {
-    putchar(27);  // ESC
-    putchar('[');
-    print_num(cols);
-    putchar('D');
+    ansi_write_num(cols, 'D');
 }
 
 void ansi_save_cursor(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('s');
+    printStr(ANSI_SAVE);
 }
 
 void ansi_restore_cursor(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('u');
+    printStr(ANSI_RESTORE);
 }
 
 void ansi_hide_cursor(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('?');
-    putchar('2');
-    putchar('5');
-    putchar('l');
+    printStr(ANSI_HIDE_CURSOR);
 }
 
 void ansi_show_cursor(void) {
-    putchar(27);  // ESC
-    putchar('[');
-    putchar('?');
-    putchar('2');
-    putchar('5');
-    putchar('h');
+    printStr(ANSI_SHOW_CURSOR);
 }
 
 // Simple box drawing (ASCII fallback)
@@ -223,34 +198,34 @@ void ansi_draw_box(int x, int y, int width, int height) {
     
     // Top border
     ansi_goto_xy(x, y);
-    putchar('+');
+    printChar('+');
     for (i = 1; i < width - 1; i++) {
-        putchar('-');
+        printChar('-');
     }
-    putchar('+');
+    printChar('+');
     
     // Side borders
     for (i = 1; i < height - 1; i++) {
         ansi_goto_xy(x, y + i);
-        putchar('|');
+        printChar('|');
         ansi_goto_xy(x + width - 1, y + i);
-        putchar('|');
+        printChar('|');
     }
     
     // Bottom border
     ansi_goto_xy(x, y + height - 1);
-    putchar('+');
+    printChar('+');
     for (i = 1; i < width - 1; i++) {
-        putchar('-');
+        printChar('-');
     }
-    putchar('+');
+    printChar('+');
 }
 
 void ansi_draw_horizontal_line(int x, int y, int length) {
     int i;
     ansi_goto_xy(x, y);
     for (i = 0; i < length; i++) {
-        putchar('-');
+        printChar('-');
     }
 }
 
@@ -258,7 +233,7 @@ void ansi_draw_vertical_line(int x, int y, int length) {
     int i;
     for (i = 0; i < length; i++) {
         ansi_goto_xy(x, y + i);
-        putchar('|');
+        printChar('|');
     }
 }
 
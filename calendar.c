@@ -0,0 +1,98 @@
+#include "calendar.h"
+
+// Calendar arithmetic
+
+// Days before each month in a common year
+unsigned int cal_month_start[13] = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365
+};
+
+// Days in each month of a common year
+unsigned char cal_month_days[12] = {
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+
+// Days before each year of a four-year cycle, which starts with the leap year
+unsigned int cal_cycle_start[5] = { 0, 366, 731, 1096, 1461 };
+
+#define calLeap(year) (((year) & 3) == 0)
+
+unsigned char calDaysInMonth(unsigned char month, unsigned char year) {
+    if (month < 1 || month > 12) return 0;
+    if (month == 2 && calLeap(year)) return 29;
+    return cal_month_days[month - 1];
+}
+
+// Returns 1 if date/month/year (year 0-99) is a real day
+int calValidDate(unsigned char date, unsigned char month, unsigned char year) {
+    return year <= 99 && date >= 1 && date <= calDaysInMonth(month, year);
+}
+
+int calValidTime(const RTC_Time *time) {
+    return time->hour <= 23 && time->minute <= 59 && time->second <= 59 &&
+           calValidDate(time->date, time->month, time->year);
+}
+
+// Seconds since 2000-01-01 00:00:00; the time must be valid
+unsigned long calToSeconds(const RTC_Time *time) {
+    unsigned int days;
+    
+    days = (time->year >> 2) * CAL_DAYS_PER_CYCLE + cal_cycle_start[time->year & 3] +
+           cal_month_start[time->month - 1] + time->date - 1;
+    if (time->month > 2 && calLeap(time->year)) days++;
+    
+    return days * CAL_SECONDS_PER_DAY +
+           (time->hour * 60U + time->minute) * 60UL + time->second;
+}
+
+// Inverse of calToSeconds; seconds must be below CAL_SECONDS
+void calFromSeconds(unsigned long seconds, RTC_Time *time) {
+    unsigned int days = seconds / CAL_SECONDS_PER_DAY;
+    unsigned int rest = seconds % CAL_SECONDS_PER_DAY / 60;   // Minutes
+    unsigned char year, month, leap;
+    
+    time->second = seconds % 60;
+    time->minute = rest % 60;
+    time->hour = rest / 60;
+    
+    // Four-year cycle, then the year within it
+    year = (days / CAL_DAYS_PER_CYCLE) * 4;
+    days %= CAL_DAYS_PER_CYCLE;
+    for (leap = 3; days < cal_cycle_start[leap]; leap--) { }
+    days -= cal_cycle_start[leap];
+    year += leap;
+    time->year = year;
+    
+    // Month: the common-year table is at most one day out, fixed for Feb 29
+    leap = calLeap(year) && days >= 59;
+    if (leap && days == 59) {
+        time->month = 2;
+        time->date = 29;
+        return;
+    }
+    days -= leap;
+    for (month = days / 31; days >= cal_month_start[month + 1]; month++) { }
+    time->month = month + 1;
+    time->date = days - cal_month_start[month] + 1;
+}
+
+// Move a time by a signed number of seconds, carrying into the date.
+// Wraps within 2000-2099.
+void calAddSeconds(RTC_Time *time, long seconds) {
+    unsigned long now = calToSeconds(time);
+    unsigned long step;
+    
+    if (seconds >= 0) {
+        step = (unsigned long)seconds % CAL_SECONDS;
+        now = now < CAL_SECONDS - step ? now + step : now - (CAL_SECONDS - step);
+    } else {
+        step = (unsigned long)-seconds % CAL_SECONDS;
+        now = now >= step ? now - step : now + (CAL_SECONDS - step);
+    }
+    calFromSeconds(now, time);
+}
+
+// Seconds from earlier to later (negative if later is earlier)
+long calDifference(const RTC_Time *later, const RTC_Time *earlier) {
+    return (long)(calToSeconds(later) - calToSeconds(earlier));
+}
@@ -0,0 +1,22 @@
+#ifndef CALENDAR_H
+#define CALENDAR_H
+
+#include "rtc.h"
+
+// Calendar arithmetic on binary (not BCD) RTC_Time values.
+// Times are counted in seconds since 2000-01-01 00:00:00; the two-digit
+// RTC year covers 2000-2099, where every fourth year is a leap year.
+#define CAL_SECONDS_PER_DAY 86400UL
+#define CAL_DAYS_PER_CYCLE  1461U       // Days in four years
+#define CAL_DAYS            36525U      // Days in 2000-2099
+#define CAL_SECONDS         (CAL_DAYS * CAL_SECONDS_PER_DAY)
+
+unsigned char calDaysInMonth(unsigned char month, unsigned char year);
+int calValidDate(unsigned char date, unsigned char month, unsigned char year);
+int calValidTime(const RTC_Time *time);
+unsigned long calToSeconds(const RTC_Time *time);
+void calFromSeconds(unsigned long seconds, RTC_Time *time);
+void calAddSeconds(RTC_Time *time, long seconds);
+long calDifference(const RTC_Time *later, const RTC_Time *earlier);
+
+#endif // CALENDAR_H
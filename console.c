@@ -0,0 +1,50 @@
+#include "console.h"
+#include "cpm.h"
+
+// One spare byte for the '$' terminator BDOS 9 needs
+char con_buffer[CON_BUFFER_SIZE + 1];
+unsigned int con_len = 0;
+unsigned char con_route = CON_SCREEN;
+void (*con_copy)(char ch);
+
+void printChar(char ch) {
+    if (con_route & CON_COPY) con_copy(ch);
+    if (!(con_route & CON_SCREEN)) return;
+    if (con_len == CON_BUFFER_SIZE) conFlush();
+    con_buffer[con_len++] = ch;
+}
+
+void printStr(char *str) {
+    if (con_route != CON_SCREEN) {
+        while (*str) printChar(*str++);
+        return;
+    }
+    while (*str) {
+        if (con_len == CON_BUFFER_SIZE) conFlush();
+        con_buffer[con_len++] = *str++;
+    }
+}
+
+// Write the buffer with one BDOS 9 call per run of text. BDOS 9 stops at
+// '$', so any '$' in the text goes out separately through BDOS 2.
+void conFlush(void) {
+    char *p = con_buffer;
+    char *end = con_buffer + con_len;
+    
+    if (con_len == 0) return;
+    *end = '$';
+    
+    while (1) {
+        if (*p != '$') cpm_print(p);
+        while (*p != '$') p++;
+        if (p == end) break;
+        cpm_putchar('$');
+        p++;
+    }
+    con_len = 0;
+}
+
+char readKey(void) {
+    conFlush();
+    return cRawIo();
+}
@@ -0,0 +1,22 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// Console output is collected here and written in bulk by conFlush().
+// Nothing is written while a measurement runs unless the buffer fills, so
+// flush before any timing window and before waiting for a key.
+#define CON_BUFFER_SIZE 128
+
+void printStr(char *str);
+void printChar(char ch);
+void conFlush(void);
+
+// Where printed text goes: the screen, a copy function, both or neither
+#define CON_SCREEN  1
+#define CON_COPY    2
+extern unsigned char con_route;
+extern void (*con_copy)(char ch);
+
+// Flush pending output, then poll the keyboard (0 = no key)
+char readKey(void);
+
+#endif // CONSOLE_H
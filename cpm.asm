@@ -1,7 +1,23 @@
-	PUBLIC	_cRawIo
+	PUBLIC	_cRawIo, _cpm_putchar, _cpm_print
+	PUBLIC	_cpm_open, _cpm_make, _cpm_close, _cpm_delete
+	PUBLIC	_cpm_read_rand, _cpm_write_rand, _cpm_set_dma, _cpm_call_rsx
+	PUBLIC	_cpm_set_return
 
 	SECTION code_user
 
+; BDOS function numbers
+C_WRITE		EQU	2
+C_WRITESTR	EQU	9
+F_OPEN		EQU	15
+F_CLOSE		EQU	16
+F_DELETE	EQU	19
+F_MAKE		EQU	22
+F_DMAOFF	EQU	26
+F_READRAND	EQU	33
+F_WRITERAND	EQU	34
+P_RSX		EQU	60
+P_CODE		EQU	108
+
 ; char cRawIo(void)
 ; check for keypress and return, otherwise 0
 _cRawIo:
@@ -10,3 +26,102 @@ _cRawIo:
 	CALL	5
 	LD	L, A
 	RET
+
+; void cpm_putchar(char c)
+; Write one character to the console (BDOS 2)
+_cpm_putchar:
+	PUSH	BC
+	PUSH	DE
+	LD	E, L
+	LD	C, C_WRITE
+	CALL	5
+	POP	DE
+	POP	BC
+	RET
+
+; void cpm_print(char *str)
+; Write a '$'-terminated string to the console (BDOS 9)
+_cpm_print:
+	PUSH	BC
+	PUSH	DE
+	EX	DE, HL			; DE = string
+	LD	C, C_WRITESTR
+	CALL	5
+	POP	DE
+	POP	BC
+	RET
+
+; int cpm_open(CPM_FCB *fcb) etc.
+; HL points to the FCB
+; Returns the BDOS status from A (0FFh = directory error)
+_cpm_open:
+	LD	C, F_OPEN
+	JR	_cpm_fcb_call
+
+_cpm_make:
+	LD	C, F_MAKE
+	JR	_cpm_fcb_call
+
+_cpm_close:
+	LD	C, F_CLOSE
+	JR	_cpm_fcb_call
+
+_cpm_delete:
+	LD	C, F_DELETE
+	JR	_cpm_fcb_call
+
+_cpm_read_rand:
+	LD	C, F_READRAND
+	JR	_cpm_fcb_call
+
+_cpm_write_rand:
+	LD	C, F_WRITERAND
+
+_cpm_fcb_call:
+	PUSH	BC
+	PUSH	DE
+	EX	DE, HL			; DE = FCB
+	CALL	5
+	LD	L, A			; Return BDOS status
+	LD	H, 0
+	POP	DE
+	POP	BC
+	RET
+
+; void cpm_set_dma(void *buffer)
+; HL points to the 128-byte record buffer
+_cpm_set_dma:
+	PUSH	BC
+	PUSH	DE
+	EX	DE, HL			; DE = buffer
+	LD	C, F_DMAOFF
+	CALL	5
+	POP	DE
+	POP	BC
+	RET
+
+; int cpm_call_rsx(CPM_RSXPB *pb)
+; HL points to the RSX parameter block
+; Returns the result from L (0FFh = no RSX took the call)
+_cpm_call_rsx:
+	PUSH	BC
+	PUSH	DE
+	EX	DE, HL			; DE = parameter block
+	LD	C, P_RSX
+	CALL	5
+	LD	H, 0
+	POP	DE
+	POP	BC
+	RET
+
+; void cpm_set_return(unsigned int code)
+; HL = program return code (0 = success, 0FF00h = error)
+_cpm_set_return:
+	PUSH	BC
+	PUSH	DE
+	EX	DE, HL			; DE = return code
+	LD	C, P_CODE
+	CALL	5
+	POP	DE
+	POP	BC
+	RET
@@ -1,6 +1,51 @@
 #ifndef __CPM_H
 #define __CPM_H
 
+// CP/M file control block
+typedef struct {
+    unsigned char drive;    // 0 = default, 1 = A: ...
+    char name[8];           // Space padded
+    char ext[3];            // Space padded
+    unsigned char ex, s1, s2, rc;
+    unsigned char alloc[16];
+    unsigned char cr;
+    unsigned char r0, r1, r2;   // Random record number
+} CPM_FCB;
+
+// Size of one CP/M record
+#define CPM_RECORD 128
+
+// BDOS directory functions return this on failure
+#define CPM_DIR_ERROR 0xFF
+
 extern char cRawIo(void);
 
+// Console output: one character (BDOS 2), '$'-terminated string (BDOS 9)
+extern void cpm_putchar(char c) __z88dk_fastcall;
+extern void cpm_print(char *str) __z88dk_fastcall;
+
+// BDOS file functions - return the BDOS status in A
+extern int cpm_open(CPM_FCB *fcb) __z88dk_fastcall;
+extern int cpm_make(CPM_FCB *fcb) __z88dk_fastcall;
+extern int cpm_close(CPM_FCB *fcb) __z88dk_fastcall;
+extern int cpm_delete(CPM_FCB *fcb) __z88dk_fastcall;
+extern int cpm_read_rand(CPM_FCB *fcb) __z88dk_fastcall;
+extern int cpm_write_rand(CPM_FCB *fcb) __z88dk_fastcall;
+extern void cpm_set_dma(void *buffer) __z88dk_fastcall;
+
+// Resident system extension parameter block (BDOS 60, CP/M 3)
+typedef struct {
+    unsigned char func;     // RSX function number
+    unsigned char params;   // Words that follow
+    void *param;
+} CPM_RSXPB;
+
+// Call an RSX. Returns the result in L, 0FFh if no RSX took the call.
+extern int cpm_call_rsx(CPM_RSXPB *pb) __z88dk_fastcall;
+
+// Set the program return code (BDOS 108, CP/M 3; CP/M 2.2 ignores it)
+#define CPM_RETURN_OK    0x0000
+#define CPM_RETURN_ERROR 0xFF00
+extern void cpm_set_return(unsigned int code) __z88dk_fastcall;
+
 #endif
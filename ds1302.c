@@ -0,0 +1,119 @@
+#include "ds1302.h"
+
+// RC2014 RTC module latch bits (same assignment as RomWBW DSRTC)
+#define DS_DATA     0x80    // Data to the DS1302
+#define DS_CLK      0x40    // Serial clock
+#define DS_READ     0x20    // Release the data line so the DS1302 can drive it
+#define DS_CE       0x10    // Chip enable
+// Port input bit 0 is the data line. The low four latch bits are not ours;
+// ds1302_port_out keeps them as they were.
+
+// DS1302 commands (register address << 1 | 0x80, bit 0 = read)
+#define DS_CMD_SECONDS_READ 0x81
+#define DS_CMD_BURST_READ   0xBF
+#define DS_CMD_WP_WRITE     0x8E
+#define DS_WP               0x80    // Write protect bit
+#define DS_CH               0x80    // Clock halt bit in the seconds register
+
+// Start a transfer: clock low, then chip enable
+void dsStart(void) {
+    ds1302_port_out(0);
+    ds1302_port_out(DS_CE);
+}
+
+// End a transfer: chip enable low
+void dsEnd(void) {
+    ds1302_port_out(0);
+}
+
+// Clock out one byte, LSB first, leaving the clock high.
+// No branches on the data, so every byte takes the same time.
+void dsWriteByte(unsigned char value) {
+    unsigned char i, bit;
+    
+    for (i = 0; i < 8; i++) {
+        bit = (value & 1) << 7;     // DS_DATA
+        ds1302_port_out(DS_CE | bit);
+        ds1302_port_out(DS_CE | bit | DS_CLK);
+        value >>= 1;
+    }
+}
+
+// Clock in one byte, LSB first. The DS1302 presents each bit on the falling
+// clock edge, so this follows a command byte or another read.
+unsigned char dsReadByte(void) {
+    unsigned char i, value = 0;
+    
+    for (i = 0; i < 8; i++) {
+        ds1302_port_out(DS_CE | DS_READ);
+        value = (value >> 1) | ((ds1302_port_in() & 1) << 7);
+        ds1302_port_out(DS_CE | DS_READ | DS_CLK);
+    }
+    return value;
+}
+
+// Write one register
+void dsWriteRegister(unsigned char command, unsigned char value) {
+    dsStart();
+    dsWriteByte(command);
+    dsWriteByte(value);
+    dsEnd();
+}
+
+// Read only the seconds register - the gate poll routine
+// Returns the BCD seconds (clock halt bit cleared), never an error
+int ds1302_get_seconds(void) {
+    unsigned char value;
+    
+    dsStart();
+    dsWriteByte(DS_CMD_SECONDS_READ);
+    value = dsReadByte();
+    dsEnd();
+    return value & 0x7F;
+}
+
+// Check for a DS1302: the seconds register must read back as BCD 00-59.
+// An empty socket floats high and reads 0xFF.
+int ds1302_detect(void) {
+    unsigned char value;
+    
+    dsStart();
+    dsWriteByte(DS_CMD_SECONDS_READ);
+    value = dsReadByte();
+    dsEnd();
+    
+    if (value == 0xFF) return 0;
+    value &= 0x7F;
+    return (value & 0x0F) <= 9 && value <= 0x59;
+}
+
+// Read the clock with one burst transfer so the fields are consistent
+// Returns 0 on success
+int ds1302_get_time(RTC_Time *time) {
+    dsStart();
+    dsWriteByte(DS_CMD_BURST_READ);
+    time->second = dsReadByte() & 0x7F;
+    time->minute = dsReadByte();
+    time->hour   = dsReadByte() & 0x3F;    // 24-hour mode
+    time->date   = dsReadByte();
+    time->month  = dsReadByte();
+    dsReadByte();                           // Day of week - not used
+    time->year   = dsReadByte();
+    dsEnd();
+    return 0;
+}
+
+// Set the clock, leaving day of week alone. Writing the seconds register
+// with the clock halt bit clear also starts a stopped clock.
+// Returns 0 on success
+int ds1302_set_time(const RTC_Time *time) {
+    dsWriteRegister(DS_CMD_WP_WRITE, 0);
+    dsWriteRegister(0x80, time->second & 0x7F);
+    dsWriteRegister(0x82, time->minute);
+    dsWriteRegister(0x84, time->hour);      // Bit 7 clear: 24-hour mode
+    dsWriteRegister(0x86, time->date);
+    dsWriteRegister(0x88, time->month);
+    dsWriteRegister(0x8C, time->year);
+    dsWriteRegister(DS_CMD_WP_WRITE, DS_WP);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef DS1302_H
+#define DS1302_H
+
+#include "rtc.h"
+
+// Direct DS1302 access on the RC2014 RTC module port, bypassing HBIOS
+int ds1302_detect(void);
+int ds1302_get_time(RTC_Time *time);
+int ds1302_set_time(const RTC_Time *time);
+int ds1302_get_seconds(void);
+
+// Port access (ds1302io.asm on the target, a simulated chip on the host).
+// ds1302_port_out changes only the RTC bits (F0h) of the latch; the other
+// bits come from the ds1302_latch shadow of the last value written. The
+// latch cannot be read back, so the shadow starts at DS1302_LATCH_INIT in
+// ds1302io.asm: a program sharing the latch must set ds1302_latch to its
+// real state before the first call.
+extern void ds1302_port_out(unsigned char value) __z88dk_fastcall;
+extern unsigned char ds1302_port_in(void);
+extern unsigned char ds1302_latch;
+
+#endif // DS1302_H
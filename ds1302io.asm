@@ -0,0 +1,48 @@
+	PUBLIC	_ds1302_port_out, _ds1302_port_in, _ds1302_latch
+
+	SECTION code_user
+
+; RC2014 RTC module latch (RomWBW DSRTC default)
+DS1302_PORT	EQU	0C0h
+
+; Latch bits not driven by ds1302.c (which uses data, clock, read and
+; chip enable, F0h). They belong to whatever else shares the latch and
+; are kept from the shadow.
+DS1302_KEEP	EQU	0Fh
+
+; The latch reads back as the RTC data line, not as written, and HBIOS
+; does not hand out its own shadow of it, so the first write sets the
+; kept bits to this value. It is the RC2014 RTC module's power-on state,
+; all clear, with nothing else on the latch; on a board where another
+; device shares it, set this to that board's RomWBW default (RTCDEF).
+DS1302_LATCH_INIT	EQU	00h
+
+;
+; Write the RTC bits of the latch, keeping the others from the shadow.
+; The latch cannot be read back, so the last value written is kept in
+; _ds1302_latch, as RomWBW does.
+; void ds1302_port_out(unsigned char value) __z88dk_fastcall
+;
+_ds1302_port_out:
+	LD	A, (_ds1302_latch)
+	XOR	L
+	AND	DS1302_KEEP		; Kept bits: shadow XOR value
+	XOR	L			; Kept bits from the shadow, RTC bits from value
+	LD	(_ds1302_latch), A
+	OUT	(DS1302_PORT), A
+	RET
+
+;
+; Read the RTC port - bit 0 is the DS1302 data line
+; unsigned char ds1302_port_in(void)
+;
+_ds1302_port_in:
+	IN	A, (DS1302_PORT)
+	LD	L, A
+	LD	H, 0
+	RET
+
+	SECTION data_user
+
+; Last value written to the latch
+_ds1302_latch:	DB	DS1302_LATCH_INIT
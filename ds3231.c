@@ -0,0 +1,199 @@
+#include "ds3231.h"
+
+// I2C address of both chips, shifted, with the read bit clear
+#define DS_I2C_ADDR     0xD0
+#define DS_I2C_READ     0x01
+
+// Registers
+#define DS_REG_SECONDS  0x00
+#define DS_REG_DAY      0x03
+#define DS3231_CONTROL  0x0E
+#define DS3231_STATUS   0x0F
+#define DS3231_AGING    0x10
+#define DS3231_CONV     0x20    // Control: start a temperature conversion
+#define DS3231_BSY      0x04    // Status: conversion running
+#define DS3231_ZERO     0x70    // Status: bits that always read 0
+
+// Status reads to wait for a conversion (one takes about 200 ms)
+#define DS3231_CONV_POLLS 5000
+
+unsigned char ds3231_model;
+
+// Start (or repeated start): SDA falls while SCL is high
+void i2cStart(void) {
+    i2c_port_out(I2C_SDA | I2C_SCL);
+    i2c_port_out(I2C_SCL);
+    i2c_port_out(0);
+}
+
+// Stop: SDA rises while SCL is high
+void i2cStop(void) {
+    i2c_port_out(0);
+    i2c_port_out(I2C_SCL);
+    i2c_port_out(I2C_SDA | I2C_SCL);
+}
+
+// Clock out one byte, MSB first. Returns 1 if the chip acknowledged it.
+int i2cWriteByte(unsigned char value) {
+    unsigned char i, bit;
+    int ack;
+    
+    for (i = 0; i < 8; i++) {
+        bit = value & 0x80;     // I2C_SDA
+        i2c_port_out(bit);
+        i2c_port_out(bit | I2C_SCL);
+        i2c_port_out(bit);
+        value <<= 1;
+    }
+    i2c_port_out(I2C_SDA);
+    i2c_port_out(I2C_SDA | I2C_SCL);
+    ack = !(i2c_port_in() & I2C_SDA);
+    i2c_port_out(I2C_SDA);
+    return ack;
+}
+
+// Clock in one byte, MSB first, acknowledging it unless it is the last
+unsigned char i2cReadByte(int last) {
+    unsigned char i, bit, value = 0;
+    
+    for (i = 0; i < 8; i++) {
+        i2c_port_out(I2C_SDA);
+        i2c_port_out(I2C_SDA | I2C_SCL);
+        value = (value << 1) | ((i2c_port_in() & I2C_SDA) ? 1 : 0);
+    }
+    i2c_port_out(I2C_SDA);
+    bit = last ? I2C_SDA : 0;
+    i2c_port_out(bit);
+    i2c_port_out(bit | I2C_SCL);
+    i2c_port_out(bit);
+    return value;
+}
+
+// Read count registers from reg on. Returns 0 on success.
+int dsRead(unsigned char reg, unsigned char *buf, unsigned char count) {
+    i2cStart();
+    if (!i2cWriteByte(DS_I2C_ADDR) || !i2cWriteByte(reg)) {
+        i2cStop();
+        return 1;
+    }
+    i2cStart();
+    if (!i2cWriteByte(DS_I2C_ADDR | DS_I2C_READ)) {
+        i2cStop();
+        return 1;
+    }
+    while (count != 0) {
+        count--;
+        *buf++ = i2cReadByte(count == 0);
+    }
+    i2cStop();
+    return 0;
+}
+
+// Write count registers from reg on. Returns 0 on success.
+int dsWrite(unsigned char reg, const unsigned char *buf, unsigned char count) {
+    int result = 0;
+    
+    i2cStart();
+    if (!i2cWriteByte(DS_I2C_ADDR) || !i2cWriteByte(reg)) result = 1;
+    while (result == 0 && count != 0) {
+        if (!i2cWriteByte(*buf++)) result = 1;
+        count--;
+    }
+    i2cStop();
+    return result;
+}
+
+// Read only the seconds register - the gate poll routine
+// Returns the BCD seconds, or 0x100 if the chip did not answer
+int ds3231_get_seconds(void) {
+    unsigned char value;
+    
+    if (dsRead(DS_REG_SECONDS, &value, 1) != 0) return 0x100;
+    return value & 0x7F;
+}
+
+// Check for a clock at the DS1307/DS3231 address and tell the two apart.
+// Bits 6-4 of the DS3231 status register always read 0 and ignore
+// writes, where a DS1307 has a byte of battery-backed RAM. So the status
+// byte is written back with those bits set: a DS3231 keeps them clear
+// (writing 1 to its flags changes nothing), and on a DS1307 the RAM
+// byte is put back as it was.
+int ds3231_detect(void) {
+    unsigned char seconds, status, probe;
+    
+    ds3231_model = DS_MODEL_NONE;
+    if (dsRead(DS_REG_SECONDS, &seconds, 1) != 0) return 0;
+    seconds &= 0x7F;
+    if ((seconds & 0x0F) > 9 || seconds > 0x59) return 0;
+    
+    ds3231_model = DS_MODEL_DS1307;
+    if (dsRead(DS3231_STATUS, &status, 1) != 0 || (status & DS3231_ZERO)) return 1;
+    probe = status | DS3231_ZERO;
+    if (dsWrite(DS3231_STATUS, &probe, 1) != 0) return 1;
+    if (dsRead(DS3231_STATUS, &probe, 1) != 0) return 1;
+    if (probe & DS3231_ZERO) {
+        dsWrite(DS3231_STATUS, &status, 1);
+    } else {
+        ds3231_model = DS_MODEL_DS3231;
+    }
+    return 1;
+}
+
+// Read the clock with one transfer so the fields are consistent
+// Returns 0 on success
+int ds3231_get_time(RTC_Time *time) {
+    unsigned char regs[7];
+    
+    if (dsRead(DS_REG_SECONDS, regs, 7) != 0) return 1;
+    time->second = regs[0] & 0x7F;
+    time->minute = regs[1];
+    time->hour   = regs[2] & 0x3F;          // 24-hour mode
+    time->date   = regs[4];
+    time->month  = regs[5] & 0x1F;          // DS3231 century bit cleared
+    time->year   = regs[6];
+    return 0;
+}
+
+// Set the clock, leaving day of week alone. Writing the seconds restarts
+// the chip's divider, so the next edge is one second on. On a DS1307 it
+// also clears the clock halt bit and starts a stopped clock.
+// Returns 0 on success
+int ds3231_set_time(const RTC_Time *time) {
+    unsigned char regs[7];
+    
+    if (dsRead(DS_REG_DAY, &regs[3], 1) != 0) return 1;
+    regs[0] = time->second & 0x7F;
+    regs[1] = time->minute;
+    regs[2] = time->hour;                   // Bit 6 clear: 24-hour mode
+    regs[4] = time->date;
+    regs[5] = time->month;
+    regs[6] = time->year;
+    return dsWrite(DS_REG_SECONDS, regs, 7);
+}
+
+int ds3231_get_aging(signed char *aging) {
+    if (ds3231_model != DS_MODEL_DS3231) return 1;
+    return dsRead(DS3231_AGING, (unsigned char *)aging, 1) != 0 ? 2 : 0;
+}
+
+// Write the offset, then start a conversion once none is running and
+// wait for it: the oscillator is only retrimmed by a conversion.
+int ds3231_set_aging(signed char aging) {
+    unsigned char value;
+    unsigned int i;
+    
+    if (ds3231_model != DS_MODEL_DS3231) return 1;
+    if (dsWrite(DS3231_AGING, (unsigned char *)&aging, 1) != 0) return 2;
+    for (i = 0; i < DS3231_CONV_POLLS; i++) {
+        if (dsRead(DS3231_STATUS, &value, 1) != 0) return 2;
+        if (!(value & DS3231_BSY)) break;
+    }
+    if (dsRead(DS3231_CONTROL, &value, 1) != 0) return 2;
+    value |= DS3231_CONV;
+    if (dsWrite(DS3231_CONTROL, &value, 1) != 0) return 2;
+    for (i = 0; i < DS3231_CONV_POLLS; i++) {
+        if (dsRead(DS3231_CONTROL, &value, 1) != 0) return 2;
+        if (!(value & DS3231_CONV)) return 0;
+    }
+    return 2;
+}
@@ -0,0 +1,41 @@
+#ifndef DS3231_H
+#define DS3231_H
+
+#include "rtc.h"
+
+// DS3231 or DS1307 on the RC2014 I2C bus (bit-banged, SC126/SC137 style
+// port), bypassing HBIOS. Both keep the time in registers 00h-06h; the
+// DS3231 also has a digital aging offset for trimming its oscillator.
+int ds3231_detect(void);
+int ds3231_get_time(RTC_Time *time);
+int ds3231_set_time(const RTC_Time *time);
+int ds3231_get_seconds(void);
+
+// Chip found by ds3231_detect()
+#define DS_MODEL_NONE   0
+#define DS_MODEL_DS1307 1
+#define DS_MODEL_DS3231 2
+extern unsigned char ds3231_model;
+
+// Aging offset: signed, about 0.1 ppm per LSB at 25 C, positive slows
+// the clock. Setting it forces a temperature conversion so it takes
+// effect at once. Both return 0 on success, 1 if the chip has no aging
+// register and 2 if it did not answer.
+#define DS3231_AGING_PPM 0.1
+int ds3231_get_aging(signed char *aging);
+int ds3231_set_aging(signed char aging);
+
+// Port access (i2cio.asm on the target, a simulated chip on the host).
+// SCL and SDA are open drain: a 1 releases the line. i2c_port_out
+// changes only those two bits of the latch; the others come from the
+// i2c_latch shadow of the last value written. The latch cannot be read
+// back, so the shadow starts at I2C_LATCH_INIT in i2cio.asm: a program
+// sharing the latch must set i2c_latch to its real state before the
+// first call.
+#define I2C_SCL 0x01
+#define I2C_SDA 0x80
+extern void i2c_port_out(unsigned char value) __z88dk_fastcall;
+extern unsigned char i2c_port_in(void);
+extern unsigned char i2c_latch;
+
+#endif // DS3231_H
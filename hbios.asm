@@ -0,0 +1,108 @@
+	PUBLIC	_hbios_cpu_khz, _hbios_timer, _hbios_timer_poll, _hbios_rtc_count
+
+	SECTION code_user
+
+	INCLUDE	"hbios.inc"
+
+;
+; Get CPU speed from HBIOS
+; unsigned int hbios_cpu_khz(void)
+; Returns: CPU clock in kHz, 0 on error
+;
+_hbios_cpu_khz:
+	PUSH	BC
+	PUSH	DE
+	
+	LD	B, BF_SYSGET		; HBIOS SYSGET function
+	LD	C, BF_SYSGET_CPUINFO	; CPU info: H=variant L=MHz DE=kHz
+	RST	08			; Call HBIOS via RST
+	
+	OR	A			; Test A for zero
+	JR	NZ, _cpu_khz_error	; Jump if error
+	
+	EX	DE, HL			; Return kHz from DE
+	JR	_cpu_khz_exit
+	
+_cpu_khz_error:
+	LD	HL, 0			; Return 0 (not available)
+	
+_cpu_khz_exit:
+	POP	DE
+	POP	BC
+	RET
+
+;
+; Read the HBIOS timer tick counter
+; int hbios_timer(HBIOS_Timer *timer) __z88dk_fastcall
+; HL points to HBIOS_Timer: +0 ticks (long), +4 ticks per second (byte)
+; Returns: HBIOS status, 0 on success
+;
+_hbios_timer:
+	PUSH	HL			; Save structure pointer
+	LD	B, BF_SYSGET		; HBIOS SYSGET function
+	LD	C, BF_SYSGET_TIMER	; Timer: DE:HL=ticks C=ticks per second
+	RST	08			; Call HBIOS via RST
+	
+	EX	(SP), HL		; HL = structure, ticks low word on stack
+	INC	HL
+	INC	HL
+	LD	(HL), E			; Ticks high word
+	INC	HL
+	LD	(HL), D
+	INC	HL
+	LD	(HL), C			; Ticks per second
+	DEC	HL
+	DEC	HL
+	DEC	HL
+	DEC	HL
+	POP	DE			; Ticks low word
+	LD	(HL), E
+	INC	HL
+	LD	(HL), D
+	
+	LD	L, A			; Return HBIOS status
+	LD	H, 0
+	RET
+
+;
+; Read the tick counter as a gate poll routine (see rtc_gate in rtc.asm)
+; int hbios_timer_poll(void)
+; Returns: low byte of the tick count in L with H = 0, or H = 1 and the
+; HBIOS error in L
+; Destroys BC, DE
+;
+_hbios_timer_poll:
+	LD	B, BF_SYSGET		; HBIOS SYSGET function
+	LD	C, BF_SYSGET_TIMER	; Timer tick count
+	RST	08			; Call HBIOS via RST
+	OR	A			; Test A for zero
+	JR	NZ, _timer_poll_error
+	LD	H, 0			; Tick count low byte is already in L
+	RET
+_timer_poll_error:
+	LD	L, A			; Return HBIOS code
+	LD	H, 1
+	RET
+
+;
+; Get the number of RTC units from HBIOS
+; unsigned int hbios_rtc_count(void)
+; Returns: RTC unit count, 0 on error
+;
+_hbios_rtc_count:
+	PUSH	BC
+	PUSH	DE
+	
+	LD	B, BF_SYSGET		; HBIOS SYSGET function
+	LD	C, BF_SYSGET_RTCCNT	; RTC count: E=units
+	RST	08			; Call HBIOS via RST
+	
+	LD	HL, 0			; Return 0 on error
+	OR	A			; Test A for zero
+	JR	NZ, _rtc_count_exit
+	LD	L, E			; Return unit count
+	
+_rtc_count_exit:
+	POP	DE
+	POP	BC
+	RET
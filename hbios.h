@@ -0,0 +1,19 @@
+#ifndef HBIOS_H
+#define HBIOS_H
+
+// HBIOS system information (SYSGET)
+extern unsigned int hbios_cpu_khz(void);
+// Number of RTC units (SYSGET RTCCNT), 0 if not reported
+extern unsigned int hbios_rtc_count(void);
+
+// HBIOS periodic timer (SYSGET TIMER)
+typedef struct {
+    unsigned long ticks;    // Ticks since boot
+    unsigned char rate;     // Ticks per second, typically 50 or 60
+} HBIOS_Timer;
+
+extern int hbios_timer(HBIOS_Timer *timer) __z88dk_fastcall;
+// Gate poll routine: low byte of the tick count, see RTC_Backend.poll
+extern int hbios_timer_poll(void);
+
+#endif // HBIOS_H
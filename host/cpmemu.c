@@ -0,0 +1,569 @@
+// CP/M and RomWBW HBIOS emulator for running the real rtccalib.com on
+// the host (make test runs it through tools/comtest.sh).
+//
+//	cpmemu [options] program.com [arguments]
+//
+// The program runs on the Z80 core in z80.c from 0100h with the command
+// tail at 0080h. CALL 5 is trapped as BDOS, RST 08 as HBIOS and a jump to
+// 0000h ends the run. Emulated time is the T-state count over the CPU
+// clock, so the program sees the same poll counts it would on a real
+// machine with that clock, however fast the host is.
+//
+// HBIOS provides RTC get and set time (20h, 21h) for one or more units,
+// and SYSGET CPU info, timer ticks and RTC count. Each RTC unit runs its
+// own error in ppm, which can change at set emulated times:
+//	-p 25		one unit 25 ppm fast
+//	-p 25,-40	two units
+//	-p 25@600:40	25 ppm, then 40 ppm from 600 s on
+// Other options:
+//	-c hz		CPU clock (default 7372800)
+//	-j us[,seed]	RMS jitter of each RTC second edge; the same seed
+//			gives the same edges
+//	-e code,n	every nth RTC call returns code (hex); B8 still
+//			returns the time, as the ROM does
+//	-r T		T-states of an HBIOS RTC call (default 2000); the
+//			clock is read half way through
+//	-s T		T-states of the other HBIOS calls (default 500)
+//	-t rate,ppm	timer ticks per second (default 50) and error
+//	-l s		stop after this many emulated seconds (default 7200)
+//	-v		list each HBIOS RTC read on stderr, with the T-state
+//			count at the call
+//
+// Console output goes to stdout, each character costing the T-states of
+// 115200 baud. Console input comes from stdin without waiting. Files are
+// lower-case NAME.EXT in the current directory, as the host build's.
+//
+// On stderr it reports the T-states of every calibration cycle (from one
+// READING line to the next) and the totals at the end. The exit status
+// is 0 when the program's CP/M 3 return code is below FF00h, 1 if above,
+// 2 if the time limit ran out and 3 if the program could not run.
+#define _DEFAULT_SOURCE
+#include "z80.h"
+#include <ctype.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CPU_HZ      7372800.0
+#define RTC_CALL_T  2000
+#define SYS_CALL_T  500
+#define BDOS_CALL_T 500
+#define CHAR_T(hz)  ((hz) * 10 / 115200)    // One character at 115200 baud
+#define TIMER_RATE  50
+#define TIME_LIMIT  7200.0
+
+// Memory map: a 57K TPA
+#define TPA_BASE    0x0100
+#define BDOS_BASE   0xE406
+#define BIOS_BASE   0xF200
+#define TAIL        0x0080
+#define FCB1        0x005C
+#define FCB2        0x006C
+
+#define MAX_UNITS   4
+#define MAX_STEPS   8
+#define RECORD      128
+
+// HBIOS functions and the status codes used here
+#define BF_RTC          0x20
+#define BF_RTCSET       0x21
+#define BF_SYSGET       0xF8
+#define SYSGET_RTCCNT   0x20
+#define SYSGET_TIMER    0xD0
+#define SYSGET_CPUINFO  0xF0
+#define ERR_NOFUNC      0xFF
+#define ERR_NOUNIT      0xFE
+
+typedef struct {
+    double from;                // Emulated seconds it starts at
+    double ppm;
+} RateStep;
+
+typedef struct {
+    RateStep steps[MAX_STEPS];
+    unsigned int count;
+    double base;                // Clock reading (Unix seconds) at time 0
+} RtcUnit;
+
+static Z80 cpu;
+static double cpu_hz = CPU_HZ;
+static RtcUnit units[MAX_UNITS];
+static unsigned int unit_count = 1;
+static double jitter;           // Seconds RMS
+static uint64_t jitter_seed;
+static unsigned int error_code, error_every;
+static unsigned long rtc_calls;
+static unsigned int rtc_call_t = RTC_CALL_T, sys_call_t = SYS_CALL_T;
+static double timer_rate = TIMER_RATE, timer_ppm;
+static double time_limit = TIME_LIMIT;
+static uint64_t tstate_limit;
+static int verbose;
+static uint16_t dma = TAIL;
+static unsigned int return_code;
+static unsigned char warned_bdos[256], warned_hbios[256];
+
+// Calibration cycles, marked by READING lines on the console
+static char line[80];
+static unsigned int line_len;
+static uint64_t cycle_start;
+static unsigned long cycle_calls;
+static unsigned int cycles;
+
+static double now(void) {
+    return cpu.tstates / cpu_hz;
+}
+
+// RTC units
+
+// Parse "ppm[@s:ppm...]" into a unit's rate steps
+static int parseRate(RtcUnit *unit, char *text, char **end) {
+    unit->count = 0;
+    unit->steps[0].from = 0;
+    for (;;) {
+        unit->steps[unit->count].ppm = strtod(text, &text);
+        unit->count++;
+        if (*text != '@') break;
+        if (unit->count == MAX_STEPS) return 0;
+        unit->steps[unit->count].from = strtod(text + 1, &text);
+        if (*text != ':') return 0;
+        text++;
+    }
+    *end = text;
+    return 1;
+}
+
+// Seconds a unit has counted by emulated time t
+static double unitElapsed(RtcUnit *unit, double t) {
+    double counted = 0, until;
+    unsigned int i;
+
+    for (i = 0; i < unit->count && unit->steps[i].from < t; i++) {
+        until = i + 1 < unit->count && unit->steps[i + 1].from < t ? unit->steps[i + 1].from : t;
+        counted += (until - unit->steps[i].from) * (1.0 + unit->steps[i].ppm * 1e-6);
+    }
+    return counted;
+}
+
+// Gaussian offset of a unit's edge k, the same every time it is asked for
+static double edgeJitter(unsigned int u, double k) {
+    uint64_t x = ((uint64_t)(int64_t)k + jitter_seed) * 0x9E3779B97F4A7C15ULL ^ (uint64_t)(u + 1) << 56;
+    double u1, u2;
+
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 29;
+    u1 = ((x >> 11) + 1.0) / 9007199254740994.0;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 32;
+    u2 = (x >> 11) / 9007199254740992.0;
+    return jitter * sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+// A unit's whole seconds at emulated time t: edge k falls at k plus its
+// jitter on the unit's own time scale
+static double unitSeconds(unsigned int u, double t) {
+    double x = units[u].base + unitElapsed(&units[u], t), n = floor(x);
+
+    if (jitter == 0) return n;
+    if (x < n + edgeJitter(u, n)) return n - 1;
+    if (x >= n + 1 + edgeJitter(u, n + 1)) return n + 1;
+    return n;
+}
+
+static uint8_t toBcd(int v) {
+    return (v / 10) << 4 | v % 10;
+}
+
+static int fromBcd(uint8_t v) {
+    return (v >> 4) * 10 + (v & 0x0F);
+}
+
+// 20h: YY MM DD HH MM SS (BCD) to the buffer at HL
+static uint8_t rtcGet(unsigned int u, uint16_t buf) {
+    time_t seconds = (time_t)unitSeconds(u, now() + rtc_call_t / 2.0 / cpu_hz);
+    struct tm tm;
+    uint8_t *p = cpu.mem;
+
+    gmtime_r(&seconds, &tm);
+    p[buf] = toBcd(tm.tm_year % 100);
+    p[(uint16_t)(buf + 1)] = toBcd(tm.tm_mon + 1);
+    p[(uint16_t)(buf + 2)] = toBcd(tm.tm_mday);
+    p[(uint16_t)(buf + 3)] = toBcd(tm.tm_hour);
+    p[(uint16_t)(buf + 4)] = toBcd(tm.tm_min);
+    p[(uint16_t)(buf + 5)] = toBcd(tm.tm_sec);
+    if (verbose) {
+        fprintf(stderr, "%llu T %.6f s: RTC %u %02d:%02d:%02d\n", (unsigned long long)cpu.tstates,
+                now(), u, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    }
+    return 0;
+}
+
+// 21h: set from the buffer; the next edge is a second later, as a chip
+// whose divider restarts when the seconds are written
+static uint8_t rtcSet(unsigned int u, uint16_t buf) {
+    struct tm tm;
+    uint8_t *p = cpu.mem;
+    double t = now() + rtc_call_t / 2.0 / cpu_hz;
+
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 100 + fromBcd(p[buf]);
+    tm.tm_mon = fromBcd(p[(uint16_t)(buf + 1)]) - 1;
+    tm.tm_mday = fromBcd(p[(uint16_t)(buf + 2)]);
+    tm.tm_hour = fromBcd(p[(uint16_t)(buf + 3)]);
+    tm.tm_min = fromBcd(p[(uint16_t)(buf + 4)]);
+    tm.tm_sec = fromBcd(p[(uint16_t)(buf + 5)]);
+    units[u].base = (double)timegm(&tm) - unitElapsed(&units[u], t);
+    return 0;
+}
+
+// HBIOS
+
+static void setBC(uint8_t b, uint8_t c) { cpu.bc = b << 8 | c; }
+static uint8_t regB(void) { return cpu.bc >> 8; }
+static uint8_t regC(void) { return cpu.bc & 0xFF; }
+
+// The call's T-states are added after it has done its work, so the clock
+// is read cost / 2 in (see rtcGet)
+static void hbios(void) {
+    uint8_t status = 0, unit = regC();
+    unsigned int cost = sys_call_t;
+    uint64_t ticks;
+
+    switch (regB()) {
+    case BF_RTC:
+    case BF_RTCSET:
+        cost = rtc_call_t;
+        rtc_calls++;
+        cycle_calls++;
+        if (unit >= unit_count) {
+            status = ERR_NOUNIT;
+            break;
+        }
+        if (error_every && rtc_calls % error_every == 0) status = error_code;
+        if (status != 0 && status != 0xB8) break;
+        if (regB() == BF_RTC) rtcGet(unit, cpu.hl);
+        else rtcSet(unit, cpu.hl);
+        break;
+    case BF_SYSGET:
+        switch (unit) {
+        case SYSGET_CPUINFO:    // H = variant, L = MHz, DE = kHz
+            cpu.hl = (uint16_t)((cpu_hz + 500000) / 1000000);
+            cpu.de = (uint16_t)((cpu_hz + 500) / 1000);
+            break;
+        case SYSGET_TIMER:      // DE:HL = ticks, C = ticks per second
+            ticks = (uint64_t)((1000.0 + now()) * (1.0 + timer_ppm * 1e-6) * timer_rate);
+            cpu.de = (uint16_t)(ticks >> 16);
+            cpu.hl = (uint16_t)ticks;
+            setBC(regB(), (uint8_t)timer_rate);
+            break;
+        case SYSGET_RTCCNT:     // E = units
+            cpu.de = unit_count;
+            break;
+        default:
+            status = ERR_NOFUNC;
+            break;
+        }
+        break;
+    default:
+        status = ERR_NOFUNC;
+        if (!warned_hbios[regB()]++) fprintf(stderr, "cpmemu: HBIOS function %02Xh not emulated\n", regB());
+        break;
+    }
+    cpu.af = status << 8 | (cpu.af & 0xFF);
+    cpu.tstates += cost;
+}
+
+// BDOS
+
+static void conOut(uint8_t c) {
+    cpu.tstates += CHAR_T(cpu_hz);
+    putchar(c);
+
+    if (c == '\n') {
+        line[line_len] = '\0';
+        if (strncmp(line, "READING", 7) == 0) {
+            cycles++;
+            fprintf(stderr, "cpmemu: cycle %u: %llu T-states (%.3f s), %lu RTC calls\n",
+                    cycles, (unsigned long long)(cpu.tstates - cycle_start),
+                    (cpu.tstates - cycle_start) / cpu_hz, cycle_calls);
+            cycle_start = cpu.tstates;
+            cycle_calls = 0;
+        }
+        line_len = 0;
+    } else if (c != '\r' && line_len < sizeof(line) - 1) {
+        line[line_len++] = c;
+    }
+}
+
+static uint8_t conIn(void) {
+    struct pollfd fd = {0, POLLIN, 0};
+    unsigned char c;
+
+    fflush(stdout);
+    if (poll(&fd, 1, 0) == 1 && (fd.revents & POLLIN) && read(0, &c, 1) == 1) return c;
+    return 0;
+}
+
+// Host file name from the FCB at addr, e.g. "rtcdrift.log"
+static char *fcbName(uint16_t addr) {
+    static char name[13];
+    char *p = name;
+    unsigned int i;
+    uint8_t c;
+
+    for (i = 1; i <= 8 && (c = cpu.mem[addr + i] & 0x7F) != ' '; i++) *p++ = tolower(c);
+    *p++ = '.';
+    for (i = 9; i <= 11 && (c = cpu.mem[addr + i] & 0x7F) != ' '; i++) *p++ = tolower(c);
+    *p = '\0';
+    return name;
+}
+
+static long fcbOffset(uint16_t addr) {
+    uint8_t *r = cpu.mem + addr + 33;
+
+    return (r[0] | r[1] << 8 | (long)r[2] << 16) * RECORD;
+}
+
+// Reading past the end returns 1 (unwritten data), as BDOS 33
+static uint8_t readRandom(uint16_t fcb) {
+    FILE *file = fopen(fcbName(fcb), "rb");
+    uint8_t buf[RECORD];
+    size_t got = 0;
+
+    if (!file) return 1;
+    if (fseek(file, fcbOffset(fcb), SEEK_SET) == 0) got = fread(buf, 1, RECORD, file);
+    fclose(file);
+    if (got == 0) return 1;
+    memset(buf + got, 0x1A, RECORD - got);
+    memcpy(cpu.mem + dma, buf, RECORD);
+    return 0;
+}
+
+static uint8_t writeRandom(uint16_t fcb) {
+    FILE *file = fopen(fcbName(fcb), "r+b");
+    uint8_t result = 2;
+
+    if (!file) return result;
+    if (fseek(file, fcbOffset(fcb), SEEK_SET) == 0 &&
+        fwrite(cpu.mem + dma, 1, RECORD, file) == RECORD) {
+        result = 0;
+    }
+    fclose(file);
+    return result;
+}
+
+static void bdos(void) {
+    uint8_t func = regC(), e = cpu.de & 0xFF, a = 0;
+    uint16_t p, hl = 0xFFFF;
+    FILE *file;
+
+    cpu.tstates += BDOS_CALL_T;
+    switch (func) {
+    case 2:
+        conOut(e);
+        break;
+    case 6:
+        if (e == 0xFF) a = conIn();
+        else if (e != 0xFE) conOut(e);
+        break;
+    case 9:
+        for (p = cpu.de; cpu.mem[p] != '$'; p++) conOut(cpu.mem[p]);
+        break;
+    case 11:
+        break;
+    case 12:
+        hl = 0x0031;            // CP/M 3.1, which has return codes
+        break;
+    case 15:
+    case 16:
+        a = access(fcbName(cpu.de), R_OK | W_OK) == 0 ? 0 : 0xFF;
+        break;
+    case 19:
+        a = remove(fcbName(cpu.de)) == 0 ? 0 : 0xFF;
+        break;
+    case 22:
+        file = fopen(fcbName(cpu.de), "wb");
+        a = file ? 0 : 0xFF;
+        if (file) fclose(file);
+        break;
+    case 26:
+        dma = cpu.de;
+        break;
+    case 33:
+        a = readRandom(cpu.de);
+        break;
+    case 34:
+        a = writeRandom(cpu.de);
+        break;
+    case 60:                    // No RSX is loaded
+        a = 0xFF;
+        break;
+    case 108:
+        if (cpu.de == 0xFFFF) hl = return_code;
+        else return_code = cpu.de;
+        break;
+    default:
+        if (!warned_bdos[func]++) fprintf(stderr, "cpmemu: BDOS function %u not emulated\n", func);
+        break;
+    }
+    if (hl == 0xFFFF) hl = a;
+    cpu.hl = hl;
+    cpu.af = (hl & 0xFF) << 8 | (cpu.af & 0xFF);
+    setBC(hl >> 8, regC());
+}
+
+// Loading
+
+// Blank FCB at addr, named from a command-line argument
+static void setFcb(uint16_t addr, const char *arg) {
+    uint8_t *fcb = cpu.mem + addr;
+    unsigned int i;
+
+    memset(fcb, 0, 16);
+    memset(fcb + 1, ' ', 11);
+    if (!arg) return;
+    if (arg[0] && arg[1] == ':') {
+        fcb[0] = toupper((unsigned char)arg[0]) - '@';
+        arg += 2;
+    }
+    for (i = 0; i < 8 && *arg && *arg != '.'; i++) fcb[1 + i] = toupper((unsigned char)*arg++);
+    while (*arg && *arg != '.') arg++;
+    if (*arg == '.') arg++;
+    for (i = 0; i < 3 && *arg; i++) fcb[9 + i] = toupper((unsigned char)*arg++);
+}
+
+static int load(const char *path, int argc, char **argv) {
+    FILE *file = fopen(path, "rb");
+    size_t size;
+    unsigned int len = 0;
+    int i;
+    const char *c;
+
+    if (!file) {
+        perror(path);
+        return 0;
+    }
+    size = fread(cpu.mem + TPA_BASE, 1, BDOS_BASE - TPA_BASE, file);
+    fclose(file);
+    if (size == 0) {
+        fprintf(stderr, "cpmemu: %s is empty\n", path);
+        return 0;
+    }
+
+    // Page zero: warm boot and BDOS jumps, HBIOS at RST 08
+    cpu.mem[0] = 0xC3;
+    cpu.mem[1] = (BIOS_BASE + 3) & 0xFF;
+    cpu.mem[2] = (BIOS_BASE + 3) >> 8;
+    cpu.mem[5] = 0xC3;
+    cpu.mem[6] = BDOS_BASE & 0xFF;
+    cpu.mem[7] = BDOS_BASE >> 8;
+    cpu.mem[8] = 0xC9;
+
+    // Command tail, upper case with a leading space, as the CCP leaves it
+    for (i = 0; i < argc; i++) {
+        if (len < 126) cpu.mem[TAIL + 1 + len++] = ' ';
+        for (c = argv[i]; *c && len < 126; c++) cpu.mem[TAIL + 1 + len++] = toupper((unsigned char)*c);
+    }
+    cpu.mem[TAIL] = len;
+    cpu.mem[TAIL + 1 + len] = 0;
+    setFcb(FCB1, argc > 0 ? argv[0] : NULL);
+    setFcb(FCB2, argc > 1 ? argv[1] : NULL);
+
+    z80_reset(&cpu);
+    cpu.sp = BDOS_BASE;
+    cpu.sp -= 2;                // Return to the CCP: a warm boot
+    cpu.mem[cpu.sp] = 0;
+    cpu.mem[cpu.sp + 1] = 0;
+    cpu.pc = TPA_BASE;
+    return 1;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: cpmemu [-c hz] [-p ppm[@s:ppm...][,ppm...]] [-j us[,seed]] [-e code,n]\n"
+                    "              [-r T] [-s T] [-t rate,ppm] [-l s] [-v] program.com [args]\n");
+    exit(3);
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    char *list;
+    unsigned int u;
+    time_t start = time(NULL);
+    struct tm local;
+
+    while ((opt = getopt(argc, argv, "+c:p:j:e:r:s:t:l:v")) != -1) {
+        switch (opt) {
+        case 'c': cpu_hz = atof(optarg); break;
+        case 'p':
+            list = optarg;
+            for (unit_count = 0; unit_count < MAX_UNITS; ) {
+                if (!parseRate(&units[unit_count++], list, &list)) usage();
+                if (*list != ',') break;
+                list++;
+            }
+            if (*list) usage();
+            break;
+        case 'j':
+            jitter = atof(optarg) * 1e-6;
+            if (strchr(optarg, ',')) jitter_seed = strtoull(strchr(optarg, ',') + 1, NULL, 10) << 32;
+            break;
+        case 'e':
+            if (sscanf(optarg, "%x,%u", &error_code, &error_every) != 2) usage();
+            break;
+        case 'r': rtc_call_t = atoi(optarg); break;
+        case 's': sys_call_t = atoi(optarg); break;
+        case 't': sscanf(optarg, "%lf,%lf", &timer_rate, &timer_ppm); break;
+        case 'l': time_limit = atof(optarg); break;
+        case 'v': verbose = 1; break;
+        default: usage();
+        }
+    }
+    if (optind >= argc || cpu_hz <= 0) usage();
+    if (units[0].count == 0) units[0].count = 1;
+
+    // Every unit starts at the host's local time, half way into a second
+    localtime_r(&start, &local);
+    for (u = 0; u < unit_count; u++) units[u].base = (double)timegm(&local) + 0.5;
+
+    if (!load(argv[optind], argc - optind - 1, argv + optind + 1)) return 3;
+    tstate_limit = (uint64_t)(time_limit * cpu_hz);
+
+    for (;;) {
+        switch (cpu.pc) {
+        case 0x0000:
+        case BIOS_BASE + 3:
+            fflush(stdout);
+            fprintf(stderr, "cpmemu: %llu T-states (%.3f s), %lu RTC calls, return code %04Xh\n",
+                    (unsigned long long)cpu.tstates, now(), rtc_calls, return_code);
+            return return_code >= 0xFF00 ? 1 : 0;
+        case 0x0005:
+        case BDOS_BASE:
+            bdos();
+            z80_ret(&cpu);
+            continue;
+        case 0x0008:
+            hbios();
+            z80_ret(&cpu);
+            continue;
+        default:
+            break;
+        }
+        if (cpu.pc >= BIOS_BASE) {
+            fprintf(stderr, "cpmemu: BIOS call at %04Xh not emulated\n", cpu.pc);
+            return 3;
+        }
+        z80_step(&cpu);
+        if (cpu.halted) {
+            fprintf(stderr, "cpmemu: HALT at %04Xh with interrupts off\n", cpu.pc);
+            return 3;
+        }
+        if (cpu.tstates > tstate_limit) {
+            fprintf(stderr, "cpmemu: stopped after %.0f emulated seconds\n", time_limit);
+            return 2;
+        }
+    }
+}
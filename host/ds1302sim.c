@@ -0,0 +1,182 @@
+// Simulated DS1302 on the RC2014 RTC module port, for host builds.
+// Replaces ds1302io.asm: ds1302_port_out() drives the chip's CE, SCLK and
+// I/O lines and ds1302_port_in() returns the I/O line in bit 0, so the
+// bit-banging in ds1302.c runs unchanged against it.
+//
+// The clock runs RTCSIM_DS1302_PPM parts per million fast against
+// CLOCK_MONOTONIC, starting at the host's local time. A read command
+// latches the time into the registers, as the chip's burst buffer does,
+// and a write to a time register restarts the clock from them.
+#include "ds1302sim.h"
+#include "../ds1302.h"
+#include "../calendar.h"
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Latch bits, as ds1302.c
+#define DS_DATA     0x80
+#define DS_CLK      0x40
+#define DS_CE       0x10
+
+#define DS_BURST_READ   0xBF
+#define DS_BURST_WRITE  0xBE
+#define DS_WP           0x80
+
+enum { PHASE_COMMAND, PHASE_WRITE, PHASE_READ };
+
+unsigned char ds1302_sim_regs[8] = {0x00, 0x00, 0x12, 0x01, 0x01, 0x01, 0x24, DS_WP};
+
+unsigned long ds1302_sim_out_count;
+unsigned long ds1302_sim_in_count;
+unsigned char ds1302_latch;
+
+static int ready;
+static double ppm, start_real, start_rtc;
+
+// Transfer state
+static unsigned char last_out;
+static unsigned char phase;
+static unsigned char command;
+static unsigned char reg;           // Register for the next data byte
+static unsigned char shift;         // Byte being assembled or sent
+static unsigned char bits;          // Bits of it so far
+static unsigned char data_line = 1; // Floats high when not driven
+
+static double realNow(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void simInit(void) {
+    time_t now = time(NULL);
+    struct tm *local = localtime(&now);
+    RTC_Time start;
+    char *value = getenv("RTCSIM_DS1302_PPM");
+
+    if (ready) return;
+    ready = 1;
+    ppm = value && *value ? atof(value) : 0.0;
+
+    start.second = local->tm_sec > 59 ? 59 : local->tm_sec;
+    start.minute = local->tm_min;
+    start.hour = local->tm_hour;
+    start.date = local->tm_mday;
+    start.month = local->tm_mon + 1;
+    start.year = local->tm_year % 100;
+    start_real = realNow();
+    start_rtc = calToSeconds(&start);
+    ds1302_sim_regs[5] = local->tm_wday + 1;
+}
+
+double ds1302_sim_seconds(double real) {
+    simInit();
+    return start_rtc + (real - start_real) * (1.0 + ppm * 1e-6);
+}
+
+double ds1302_sim_real(double seconds) {
+    simInit();
+    return start_real + (seconds - start_rtc) / (1.0 + ppm * 1e-6);
+}
+
+// Copy the running time into the registers. A halted clock (CH set)
+// keeps the registers as they are.
+static void latchTime(void) {
+    RTC_Time now;
+    unsigned char *r = ds1302_sim_regs;
+
+    if (r[0] & 0x80) return;
+    calFromSeconds((unsigned long)fmod(floor(ds1302_sim_seconds(realNow())), CAL_SECONDS), &now);
+    rtc_time_to_bcd(&now);
+    r[0] = now.second;
+    r[1] = now.minute;
+    r[2] = now.hour;
+    r[3] = now.date;
+    r[4] = now.month;
+    r[6] = now.year;
+}
+
+// Restart the clock from the registers after one was written
+static void takeTime(void) {
+    RTC_Time set;
+    unsigned char *r = ds1302_sim_regs;
+
+    set.second = r[0] & 0x7F;
+    set.minute = r[1];
+    set.hour = r[2] & 0x3F;
+    set.date = r[3];
+    set.month = r[4];
+    set.year = r[6];
+    rtc_time_from_bcd(&set);
+    if (!calValidTime(&set)) return;
+    start_real = realNow();
+    start_rtc = calToSeconds(&set);
+}
+
+// Rising clock edge: the chip latches the I/O line
+static void risingEdge(unsigned char value) {
+    if (phase == PHASE_READ) return;
+
+    shift = (shift >> 1) | ((value & DS_DATA) ? 0x80 : 0);
+    if (++bits < 8) return;
+    bits = 0;
+
+    if (phase == PHASE_COMMAND) {
+        command = shift;
+        reg = (command == DS_BURST_READ || command == DS_BURST_WRITE) ? 0 : (command >> 1) & 0x1F;
+        phase = (command & 1) ? PHASE_READ : PHASE_WRITE;
+        if (phase == PHASE_READ) {
+            latchTime();
+            bits = 8;   // First falling edge loads the register
+        }
+        return;
+    }
+
+    // Data byte written - the control register is always writable
+    if (reg == 7 || (reg < 7 && !(ds1302_sim_regs[7] & DS_WP))) {
+        if (reg < 7) latchTime();
+        ds1302_sim_regs[reg] = shift;
+        if (reg < 7) takeTime();
+    }
+    if (command == DS_BURST_WRITE) reg++;
+}
+
+// Falling clock edge: when reading, the chip presents the next bit
+static void fallingEdge(void) {
+    if (phase != PHASE_READ) return;
+
+    if (bits == 8) {
+        shift = reg < 8 ? ds1302_sim_regs[reg] : 0xFF;
+        if (command == DS_BURST_READ) reg++;
+        bits = 0;
+    }
+    data_line = shift & 1;
+    shift >>= 1;
+    bits++;
+}
+
+void ds1302_port_out(unsigned char value) {
+    ds1302_sim_out_count++;
+    ds1302_latch = (ds1302_latch & 0x0F) | (value & 0xF0);
+
+    if (!(value & DS_CE)) {
+        // Deselected - the next transfer starts with a command
+        phase = PHASE_COMMAND;
+        shift = 0;
+        bits = 0;
+        data_line = 1;
+    } else if ((value & DS_CLK) && !(last_out & DS_CLK)) {
+        risingEdge(value);
+    } else if (!(value & DS_CLK) && (last_out & DS_CLK)) {
+        fallingEdge();
+    }
+
+    last_out = value;
+}
+
+unsigned char ds1302_port_in(void) {
+    ds1302_sim_in_count++;
+    return data_line;
+}
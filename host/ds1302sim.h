@@ -0,0 +1,16 @@
+#ifndef DS1302SIM_H
+#define DS1302SIM_H
+
+// Clock registers in DS1302 order: sec min hour date month day year control
+extern unsigned char ds1302_sim_regs[8];
+
+// Port accesses so far
+extern unsigned long ds1302_sim_out_count;
+extern unsigned long ds1302_sim_in_count;
+
+// Clock seconds since 2000 at a monotonic time, and the inverse, for the
+// simulated gate (see hostrtc.c)
+double ds1302_sim_seconds(double real);
+double ds1302_sim_real(double seconds);
+
+#endif // DS1302SIM_H
@@ -0,0 +1,234 @@
+// Simulated DS3231 (or DS1307) on the RC2014 I2C port, for host builds.
+// Replaces i2cio.asm: i2c_port_out() drives SCL and SDA and
+// i2c_port_in() returns the wired-AND SDA line in bit 7, so the
+// bit-banging in ds3231.c runs unchanged against it.
+//
+// The clock runs RTCSIM_I2C_PPM parts per million fast against
+// CLOCK_MONOTONIC, starting at the host's local time. On a DS3231 each
+// LSB of the aging register slows it by RTCSIM_I2C_LSB ppm (default 0.1)
+// once a temperature conversion has been started, as on the chip.
+// RTCSIM_I2C=1307 makes it a DS1307 and RTCSIM_I2C=0 removes it.
+#include "ds3231sim.h"
+#include "../ds3231.h"
+#include "../calendar.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DS_ADDR         0x68
+#define DS3231_CONTROL  0x0E
+#define DS3231_STATUS   0x0F
+#define DS3231_AGING    0x10
+#define DS3231_CONV     0x20
+#define DS3231_FLAGS    0x83    // Status bits that can only be cleared
+#define DS3231_EN32KHZ  0x08
+
+enum { BUS_IDLE, BUS_ADDRESS, BUS_REGISTER, BUS_WRITE, BUS_READ, BUS_NACKED };
+
+unsigned char ds3231_sim_regs[64];
+unsigned char i2c_latch = I2C_SCL | I2C_SDA;
+
+unsigned long ds3231_sim_out_count;
+unsigned long ds3231_sim_in_count;
+
+static int ready, present, ds1307;
+static unsigned char reg_count;     // Registers before the pointer wraps
+static double base_ppm, lsb_ppm, ppm;
+static double start_real, start_rtc;
+
+// Bus state
+static unsigned char last_out = I2C_SCL | I2C_SDA;
+static unsigned char state;
+static unsigned char shift;
+static unsigned char bits;          // Bits of the byte so far, 9 after the ack
+static unsigned char pointer;
+static unsigned char sda_out = 1;   // Chip's SDA, 1 = released
+static unsigned char sending;       // The byte in shift is ours
+static unsigned char time_written;
+
+static double realNow(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double envDouble(const char *name, double fallback) {
+    char *value = getenv(name);
+
+    return value && *value ? atof(value) : fallback;
+}
+
+static void simInit(void) {
+    time_t now = time(NULL);
+    struct tm *local = localtime(&now);
+    RTC_Time start;
+    char *chip = getenv("RTCSIM_I2C");
+
+    if (ready) return;
+    ready = 1;
+    present = !chip || strcmp(chip, "0") != 0;
+    ds1307 = chip && strcmp(chip, "1307") == 0;
+    reg_count = ds1307 ? 64 : 0x13;
+    base_ppm = ppm = envDouble("RTCSIM_I2C_PPM", 0.0);
+    lsb_ppm = envDouble("RTCSIM_I2C_LSB", DS3231_AGING_PPM);
+
+    start.second = local->tm_sec > 59 ? 59 : local->tm_sec;
+    start.minute = local->tm_min;
+    start.hour = local->tm_hour;
+    start.date = local->tm_mday;
+    start.month = local->tm_mon + 1;
+    start.year = local->tm_year % 100;
+    start_real = realNow();
+    start_rtc = calToSeconds(&start);
+    ds3231_sim_regs[3] = local->tm_wday + 1;
+    ds3231_sim_regs[0x11] = 25;     // Temperature, 25.00 C
+}
+
+double ds3231_sim_seconds(double real) {
+    simInit();
+    return start_rtc + (real - start_real) * (1.0 + ppm * 1e-6);
+}
+
+double ds3231_sim_real(double seconds) {
+    simInit();
+    return start_real + (seconds - start_rtc) / (1.0 + ppm * 1e-6);
+}
+
+// Restart the clock at a time (seconds since 2000), now
+static void restart(double seconds) {
+    start_real = realNow();
+    start_rtc = seconds;
+}
+
+// Latch the time into registers 00h-06h, as the chip does at a start
+static void latchTime(void) {
+    RTC_Time now;
+    unsigned char *r = ds3231_sim_regs;
+
+    calFromSeconds((unsigned long)fmod(floor(ds3231_sim_seconds(realNow())), CAL_SECONDS), &now);
+    rtc_time_to_bcd(&now);
+    r[0] = (r[0] & 0x80) | now.second;
+    r[1] = now.minute;
+    r[2] = now.hour;
+    r[4] = now.date;
+    r[5] = now.month;
+    r[6] = now.year;
+}
+
+// A stop after writing the time restarts the clock from the registers
+static void takeTime(void) {
+    RTC_Time set;
+    unsigned char *r = ds3231_sim_regs;
+
+    set.second = r[0] & 0x7F;
+    set.minute = r[1];
+    set.hour = r[2] & 0x3F;
+    set.date = r[4];
+    set.month = r[5] & 0x1F;
+    set.year = r[6];
+    rtc_time_from_bcd(&set);
+    if (calValidTime(&set)) restart(calToSeconds(&set));
+}
+
+// A conversion applies the aging offset
+static void convert(void) {
+    restart(ds3231_sim_seconds(realNow()));
+    ppm = base_ppm - lsb_ppm * (signed char)ds3231_sim_regs[DS3231_AGING];
+    ds3231_sim_regs[DS3231_CONTROL] &= ~DS3231_CONV;
+}
+
+// A byte from the controller, after its eighth bit
+static void received(void) {
+    if (state == BUS_ADDRESS) {
+        if ((shift >> 1) != DS_ADDR || !present) {
+            state = BUS_IDLE;
+            return;
+        }
+        state = (shift & 1) ? BUS_READ : BUS_REGISTER;
+    } else if (state == BUS_REGISTER) {
+        pointer = shift % reg_count;
+        state = BUS_WRITE;
+    } else {
+        if (!ds1307 && pointer == DS3231_STATUS) {
+            // Flags are cleared by writing 0, BSY and bits 6-4 are read-only
+            shift = (ds3231_sim_regs[pointer] & ~(DS3231_FLAGS | DS3231_EN32KHZ)) |
+                    (ds3231_sim_regs[pointer] & shift & DS3231_FLAGS) | (shift & DS3231_EN32KHZ);
+        }
+        ds3231_sim_regs[pointer] = shift;
+        if (pointer < 7) time_written = 1;
+        if (!ds1307 && pointer == DS3231_CONTROL && (shift & DS3231_CONV)) convert();
+        pointer = (pointer + 1) % reg_count;
+    }
+    sda_out = 0;    // Acknowledge
+}
+
+// Rising SCL: a bit from the controller, or its ack of a byte we sent
+static void risingEdge(unsigned char value) {
+    if (state == BUS_IDLE || state == BUS_NACKED) return;
+    if (bits < 8) {
+        if (!sending) shift = (shift << 1) | ((value & I2C_SDA) ? 1 : 0);
+        bits++;
+    } else if (bits == 8) {
+        if (sending && (value & I2C_SDA)) state = BUS_NACKED;
+        bits = 9;
+    }
+}
+
+// Falling SCL: take a full byte, or put the next bit on SDA
+static void fallingEdge(void) {
+    if (state == BUS_IDLE || state == BUS_NACKED) return;
+    if (bits == 9) {
+        sda_out = 1;
+        bits = 0;
+        sending = state == BUS_READ;
+        if (sending) {
+            shift = ds3231_sim_regs[pointer];
+            pointer = (pointer + 1) % reg_count;
+            sda_out = shift >> 7;
+        }
+    } else if (bits == 8) {
+        if (sending) {
+            sda_out = 1;    // Controller acks
+        } else {
+            received();
+        }
+    } else if (sending && bits > 0) {
+        sda_out = (shift >> (7 - bits)) & 1;
+    }
+}
+
+void i2c_port_out(unsigned char value) {
+    unsigned char scl = value & I2C_SCL, sda = value & I2C_SDA;
+
+    simInit();
+    ds3231_sim_out_count++;
+    i2c_latch = value;
+    if (scl && (last_out & I2C_SCL) && sda != (last_out & I2C_SDA)) {
+        if (!sda) {
+            // Start
+            state = BUS_ADDRESS;
+            bits = 0;
+            sending = 0;
+            sda_out = 1;
+            latchTime();
+        } else {
+            // Stop
+            state = BUS_IDLE;
+            sda_out = 1;
+            if (time_written) takeTime();
+            time_written = 0;
+        }
+    } else if (scl && !(last_out & I2C_SCL)) {
+        risingEdge(value);
+    } else if (!scl && (last_out & I2C_SCL)) {
+        fallingEdge();
+    }
+    last_out = value;
+}
+
+unsigned char i2c_port_in(void) {
+    ds3231_sim_in_count++;
+    return ((last_out & I2C_SDA) && sda_out) ? I2C_SDA : 0;
+}
@@ -0,0 +1,16 @@
+#ifndef DS3231SIM_H
+#define DS3231SIM_H
+
+// Registers: DS3231 00h-12h, or DS1307 00h-07h and RAM 08h-3Fh
+extern unsigned char ds3231_sim_regs[64];
+
+// Bus accesses so far
+extern unsigned long ds3231_sim_out_count;
+extern unsigned long ds3231_sim_in_count;
+
+// Clock seconds since 2000 at a monotonic time, and the inverse, for the
+// simulated gate (see hostrtc.c)
+double ds3231_sim_seconds(double real);
+double ds3231_sim_real(double seconds);
+
+#endif // DS3231SIM_H
@@ -0,0 +1,156 @@
+// CP/M BDOS calls for host builds.
+// Replaces cpm.asm. The console is stdin/stdout (raw mode when it is a
+// terminal), or a new pseudo-terminal when RTCSIM_PTY is set: its name is
+// printed on stderr so a terminal program can attach to it. Files are
+// lower-case NAME.EXT in the current directory.
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include "../cpm.h"
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+static int con_in = -1, con_out = 1;
+static struct termios saved_tty;
+static void *dma;
+
+static void restoreTty(void) {
+    tcsetattr(0, TCSANOW, &saved_tty);
+}
+
+static void setRaw(int fd) {
+    struct termios tty;
+
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(fd, TCSANOW, &tty);
+}
+
+static void conInit(void) {
+    int slave;
+
+    if (con_in >= 0) return;
+
+    if (getenv("RTCSIM_PTY")) {
+        con_in = posix_openpt(O_RDWR | O_NOCTTY);
+        if (con_in < 0 || grantpt(con_in) || unlockpt(con_in)) {
+            perror("pty");
+            exit(1);
+        }
+        // Held open so output is kept until a terminal attaches
+        slave = open(ptsname(con_in), O_RDWR | O_NOCTTY);
+        if (slave >= 0) setRaw(slave);
+        fprintf(stderr, "Console on %s\n", ptsname(con_in));
+        con_out = con_in;
+    } else {
+        con_in = 0;
+        if (isatty(0)) {
+            tcgetattr(0, &saved_tty);
+            atexit(restoreTty);
+            setRaw(0);
+        }
+    }
+    fcntl(con_in, F_SETFL, fcntl(con_in, F_GETFL) | O_NONBLOCK);
+}
+
+// BDOS 6 with E = FFh: next key, or 0 if none is waiting
+char cRawIo(void) {
+    char ch;
+
+    conInit();
+    return read(con_in, &ch, 1) == 1 ? ch : 0;
+}
+
+void cpm_putchar(char c) {
+    conInit();
+    if (write(con_out, &c, 1) != 1) exit(1);
+}
+
+void cpm_print(char *str) {
+    char *end = strchr(str, '$');
+
+    conInit();
+    if (end && end > str && write(con_out, str, end - str) != end - str) exit(1);
+}
+
+// Host file name from the FCB, e.g. "rtcdrift.log"
+static char *fcbName(CPM_FCB *fcb) {
+    static char name[13];
+    char *p = name;
+    unsigned char i;
+
+    for (i = 0; i < 8 && fcb->name[i] != ' '; i++) *p++ = tolower(fcb->name[i]);
+    *p++ = '.';
+    for (i = 0; i < 3 && fcb->ext[i] != ' '; i++) *p++ = tolower(fcb->ext[i]);
+    *p = '\0';
+    return name;
+}
+
+static long fcbOffset(CPM_FCB *fcb) {
+    return (fcb->r0 | fcb->r1 << 8 | (long)fcb->r2 << 16) * (long)CPM_RECORD;
+}
+
+int cpm_open(CPM_FCB *fcb) {
+    return access(fcbName(fcb), R_OK | W_OK) == 0 ? 0 : CPM_DIR_ERROR;
+}
+
+int cpm_make(CPM_FCB *fcb) {
+    FILE *file = fopen(fcbName(fcb), "wb");
+
+    if (!file) return CPM_DIR_ERROR;
+    fclose(file);
+    return 0;
+}
+
+int cpm_close(CPM_FCB *fcb) {
+    return cpm_open(fcb);
+}
+
+int cpm_delete(CPM_FCB *fcb) {
+    return remove(fcbName(fcb)) == 0 ? 0 : CPM_DIR_ERROR;
+}
+
+// Reading past the end returns 1 (unwritten data), as BDOS 33
+int cpm_read_rand(CPM_FCB *fcb) {
+    FILE *file = fopen(fcbName(fcb), "rb");
+    size_t got = 0;
+
+    if (!file) return 1;
+    if (fseek(file, fcbOffset(fcb), SEEK_SET) == 0) got = fread(dma, 1, CPM_RECORD, file);
+    fclose(file);
+    if (got == 0) return 1;
+    memset((char *)dma + got, 0x1A, CPM_RECORD - got);
+    return 0;
+}
+
+int cpm_write_rand(CPM_FCB *fcb) {
+    FILE *file = fopen(fcbName(fcb), "r+b");
+    int result = 2;
+
+    if (!file) return result;
+    if (fseek(file, fcbOffset(fcb), SEEK_SET) == 0 &&
+        fwrite(dma, 1, CPM_RECORD, file) == CPM_RECORD) {
+        result = 0;
+    }
+    fclose(file);
+    return result;
+}
+
+void cpm_set_dma(void *buffer) {
+    dma = buffer;
+}
+
+// No RSX is ever loaded on the host
+int cpm_call_rsx(CPM_RSXPB *pb) {
+    (void)pb;
+    return 0xFF;
+}
+
+// The host program's exit status comes from main() instead
+void cpm_set_return(unsigned int code) {
+    (void)code;
+}
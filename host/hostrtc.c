@@ -0,0 +1,382 @@
+// Virtual RTC and CPU for host builds.
+// Replaces rtc.asm and hbios.asm. The RTC runs RTCSIM_PPM parts per million
+// fast (negative: slow) against CLOCK_MONOTONIC, starting at the host's local
+// time. A comma-separated list (RTCSIM_PPM=12,-40) gives one HBIOS RTC unit
+// per figure. The CPU is a virtual RTCSIM_CPU_HZ Z80 whose HBIOS seconds read costs
+// RTCSIM_POLL_T T-states, so rtc_gate() returns the poll counts the real
+// gate would on a machine with that clock and that RTC error.
+//
+// The HBIOS timer ticks RTCSIM_TIMER_RATE times a second (default 50), off
+// by RTCSIM_TIMER_PPM from the monotonic clock.
+//
+// For trying the error paths and the statistics:
+//	RTCSIM_JITTER=us	RMS jitter of each second edge
+//	RTCSIM_ERROR=code,n	every nth HBIOS RTC call returns code (hex);
+//				B8 still returns the time, as the ROM does
+//	RTCSIM_TRACE		print each gate's polls and T-states on stderr
+#include "../rtc.h"
+#include "../hbios.h"
+#include "../calendar.h"
+#include "../ds1302.h"
+#include "../ds3231.h"
+#include "ds1302sim.h"
+#include "ds3231sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SIM_CPU_HZ  7372800.0
+#define SIM_POLL_T  2000.0      // Rough cost of an HBIOS RTC call
+#define SIM_TIMER_RATE 50
+
+static int ready;
+static double ppm[RTC_MAX_UNITS], cpu_hz, poll_t, jitter;
+static unsigned char units = 1;
+static double timer_ppm, timer_rate, timer_start;
+static unsigned int error_code, error_every, calls;
+static int trace;
+static double start_real[RTC_MAX_UNITS];   // Monotonic time of the last set
+static double start_rtc[RTC_MAX_UNITS];    // RTC seconds since 2000 then
+
+unsigned char hbios_rtc_unit;
+
+static double realNow(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleepUntil(double real) {
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)real;
+    ts.tv_nsec = (long)((real - ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) { }
+}
+
+static double envDouble(const char *name, double fallback) {
+    char *value = getenv(name);
+
+    return value && *value ? atof(value) : fallback;
+}
+
+static void simInit(void) {
+    time_t now = time(NULL);
+    struct tm *local = localtime(&now);
+    RTC_Time start;
+    char *list = getenv("RTCSIM_PPM");
+    unsigned char unit;
+
+    if (ready) return;
+    ready = 1;
+    while (list && *list) {
+        ppm[units - 1] = strtod(list, &list);
+        if (*list != ',' || units == RTC_MAX_UNITS) break;
+        list++;
+        units++;
+    }
+    cpu_hz = envDouble("RTCSIM_CPU_HZ", SIM_CPU_HZ);
+    poll_t = envDouble("RTCSIM_POLL_T", SIM_POLL_T);
+    jitter = envDouble("RTCSIM_JITTER", 0.0) * 1e-6;
+    if (getenv("RTCSIM_ERROR")) sscanf(getenv("RTCSIM_ERROR"), "%x,%u", &error_code, &error_every);
+    trace = getenv("RTCSIM_TRACE") != NULL;
+    timer_ppm = envDouble("RTCSIM_TIMER_PPM", 0.0);
+    timer_rate = envDouble("RTCSIM_TIMER_RATE", SIM_TIMER_RATE);
+
+    start.second = local->tm_sec > 59 ? 59 : local->tm_sec;
+    start.minute = local->tm_min;
+    start.hour = local->tm_hour;
+    start.date = local->tm_mday;
+    start.month = local->tm_mon + 1;
+    start.year = local->tm_year % 100;
+    for (unit = 0; unit < RTC_MAX_UNITS; unit++) {
+        start_real[unit] = realNow();
+        start_rtc[unit] = calToSeconds(&start);
+    }
+    timer_start = start_real[0] - 1000.0;  // Booted a while ago
+}
+
+// A unit's RTC seconds since 2000 at a monotonic time
+static double unitAt(unsigned char u, double real) {
+    return start_rtc[u] + (real - start_real[u]) * (1.0 + ppm[u] * 1e-6);
+}
+
+// The monotonic time at which a unit reads rtc_seconds
+static double unitRealAt(unsigned char u, double rtc_seconds) {
+    return start_real[u] + (rtc_seconds - start_rtc[u]) / (1.0 + ppm[u] * 1e-6);
+}
+
+// The same for the selected unit, and the inverse
+static double rtcAt(double real) {
+    return unitAt(hbios_rtc_unit, real);
+}
+
+static double realAt(double rtc_seconds) {
+    return unitRealAt(hbios_rtc_unit, rtc_seconds);
+}
+
+// Timer ticks at a monotonic time, and the inverse
+static double ticksAt(double real) {
+    return (real - timer_start) * (1.0 + timer_ppm * 1e-6) * timer_rate;
+}
+
+static double realAtTicks(double ticks) {
+    return timer_start + ticks / timer_rate / (1.0 + timer_ppm * 1e-6);
+}
+
+// Gaussian edge jitter (Box-Muller)
+static double edgeJitter(void) {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = rand() / (RAND_MAX + 1.0);
+
+    return jitter * sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+// Status of the next HBIOS RTC call, 0 unless an error is due
+static unsigned int callStatus(unsigned char unit) {
+    simInit();
+    if (unit >= units) return 0xFF;  // No such unit
+    if (error_every == 0 || ++calls % error_every != 0) return 0;
+    return error_code;
+}
+
+// Read a unit, returning the HBIOS status
+static int rtcRead(unsigned char unit, RTC_Time *time) {
+    unsigned int status = callStatus(unit);
+
+    if (status != 0 && status != 0xB8) return status;
+    calFromSeconds((unsigned long)fmod(floor(unitAt(unit, realNow())), CAL_SECONDS), time);
+    rtc_time_to_bcd(time);
+    return status;
+}
+
+// Set a unit, returning the HBIOS status
+static int rtcWrite(unsigned char unit, const RTC_Time *time) {
+    RTC_Time start = *time;
+    unsigned int status = callStatus(unit);
+
+    if (status != 0 && status != 0xB8) return status;
+    rtc_time_from_bcd(&start);
+    if (!calValidTime(&start)) return 1;
+    start_real[unit] = realNow();
+    start_rtc[unit] = calToSeconds(&start);
+    return status;
+}
+
+int hbios_rtc_detect(void) {
+    simInit();
+    return hbios_rtc_unit < units;
+}
+
+int hbios_rtc_get_time(RTC_Time *time) {
+    return rtcRead(hbios_rtc_unit, time);
+}
+
+// 0 or -1, as rtc.asm
+int hbios_rtc_set_time(const RTC_Time *time) {
+    return rtcWrite(hbios_rtc_unit, time) == 0 ? 0 : -1;
+}
+
+int hbios_rtc_read(RTC_HbiosTime *buf) {
+    RTC_Time time;
+    int status = rtcRead(buf->unit, &time);
+
+    if (status != 0 && status != 0xB8) return status;
+    buf->year = time.year;
+    buf->month = time.month;
+    buf->date = time.date;
+    buf->hour = time.hour;
+    buf->minute = time.minute;
+    buf->second = time.second;
+    return status;
+}
+
+int hbios_rtc_write(const RTC_HbiosTime *buf) {
+    RTC_Time time;
+
+    time.second = buf->second;
+    time.minute = buf->minute;
+    time.hour = buf->hour;
+    time.date = buf->date;
+    time.month = buf->month;
+    time.year = buf->year;
+    return rtcWrite(buf->unit, &time);
+}
+
+int hbios_rtc_test(void) {
+    return 0;
+}
+
+int hbios_rtc_poll(void) {
+    RTC_Time time;
+    int status = rtcRead(hbios_rtc_unit, &time);
+
+    if (status != 0 && status != 0xB8) return 0x100 | status;
+    return time.second;
+}
+
+// Polls run back to back from the moment the gate starts, each costing
+// RTC_POLL_TSTATES + RTCSIM_POLL_T + the spin, and the poll that sees an
+// edge RTC_EDGE_TSTATES more, followed by the gate's idle units. The sync
+// poll is padded to match. An edge is seen by the first poll at or after
+// it, which gives the real gate's one-poll quantisation. Error returns are
+// only injected into the first poll. Gates on the HBIOS timer count its
+// ticks instead of RTC seconds, and gates on the DS1302 and I2C clocks
+// follow their simulated chips.
+int rtc_gate(RTC_Gate *gate) {
+    double (*valueAt)(double) = rtcAt;
+    double (*realOf)(double) = realAt;
+    double t0, now, cost, edge, polls, tail;
+    unsigned long count = 0;
+    unsigned int i;
+    int result;
+
+    simInit();
+    result = gate->poll();
+    if (result & 0xFF00) return result;
+    if (gate->poll == hbios_timer_poll) {
+        valueAt = ticksAt;
+        realOf = realAtTicks;
+    } else if (gate->poll == ds1302_get_seconds) {
+        valueAt = ds1302_sim_seconds;
+        realOf = ds1302_sim_real;
+    } else if (gate->poll == ds3231_get_seconds) {
+        valueAt = ds3231_sim_seconds;
+        realOf = ds3231_sim_real;
+    }
+
+    // Sync: the first poll at or after the next edge
+    t0 = now = realNow();
+    cost = (RTC_POLL_TSTATES + poll_t) / cpu_hz;
+    tail = (RTC_EDGE_TSTATES + RTC_IDLE_TSTATES(gate->idle)) / cpu_hz;
+    edge = floor(valueAt(now)) + 1;
+    now += ceil((realOf(edge) - now) / cost) * cost + tail;
+
+    for (i = 0; i < gate->seconds; i++) {
+        edge++;
+        cost = (RTC_POLL_TSTATES + poll_t + RTC_SPIN_TSTATES(gate->spin)) / cpu_hz;
+        polls = ceil((realOf(edge) + edgeJitter() - now) / cost);
+        if (polls < 1) polls = 1;
+        now += polls * cost + tail;
+        count += (unsigned long)polls;
+        if (gate->marks) gate->marks[i] = polls > 0xFFFF ? 0xFFFF : (unsigned int)polls;
+    }
+    sleepUntil(now);
+
+    gate->polls = count;
+    if (trace) {
+        fprintf(stderr, "gate %u s spin %u: %lu polls, %.0f T-states with sync\n",
+                gate->seconds, gate->spin, gate->polls, (now - t0) * cpu_hz);
+    }
+    return 0;
+}
+
+// Passes run back to back, each RTC_UNITS_PASS_TSTATES plus, per unit,
+// RTC_UNITS_POLL_TSTATES + RTCSIM_POLL_T, with RTC_UNITS_EDGE_TSTATES
+// more after each poll that sees an edge, as in rtc.asm. A unit's poll
+// reads it when the poll starts.
+int rtc_gate_units(RTC_UnitGate *gate) {
+    double second[RTC_MAX_UNITS], edge_real[RTC_MAX_UNITS];
+    double t0, now, poll, edge_t;
+    unsigned long passes = 0;
+    unsigned int edges = 0;
+    unsigned char left = gate->units, i;
+    RTC_UnitRecord *rec;
+    unsigned int status;
+
+    simInit();
+    t0 = now = realNow();
+    poll = (RTC_UNITS_POLL_TSTATES + poll_t) / cpu_hz;
+    edge_t = RTC_UNITS_EDGE_TSTATES / cpu_hz;
+    for (i = 0; i < gate->units; i++) {
+        rec = &gate->unit[i];
+        status = callStatus(rec->unit);
+        if (status != 0 && status != 0xB8) return status;
+        rec->left = gate->seconds + 1;
+        rec->first.passes = rec->last.passes = 0;
+        rec->first.edges = rec->last.edges = 0;
+        second[i] = floor(unitAt(rec->unit, now)) + 1;
+        edge_real[i] = unitRealAt(rec->unit, second[i]) + edgeJitter();
+        now += poll;
+    }
+
+    while (left) {
+        passes++;
+        now += RTC_UNITS_PASS_TSTATES / cpu_hz;
+        for (i = 0; i < gate->units; i++) {
+            rec = &gate->unit[i];
+            if (now >= edge_real[i]) {
+                edges++;
+                rec->last.passes = passes;
+                rec->last.edges = edges;
+                if (rec->left == gate->seconds + 1) rec->first = rec->last;
+                if (--rec->left == 0) left--;
+                second[i]++;
+                edge_real[i] = unitRealAt(rec->unit, second[i]) + edgeJitter();
+                now += edge_t;
+            }
+            now += poll;
+        }
+    }
+    sleepUntil(now);
+
+    if (trace) {
+        fprintf(stderr, "unit gate %u s over %u units: %lu passes, %.0f T-states\n",
+                gate->seconds, gate->units, passes, (now - t0) * cpu_hz);
+    }
+    return 0;
+}
+
+unsigned int hbios_cpu_khz(void) {
+    simInit();
+    return (unsigned int)(cpu_hz / 1000.0);
+}
+
+unsigned int hbios_rtc_count(void) {
+    simInit();
+    return units;
+}
+
+int hbios_timer(HBIOS_Timer *timer) {
+    simInit();
+    timer->ticks = (unsigned long)floor(ticksAt(realNow()));
+    timer->rate = (unsigned char)timer_rate;
+    return 0;
+}
+
+int hbios_timer_poll(void) {
+    simInit();
+    return (unsigned long)floor(ticksAt(realNow())) & 0xFF;
+}
+
+// BCD conversions, as rtc.asm
+
+unsigned char rtc_bcd_to_bin(unsigned char bcd) {
+    if ((bcd & 0x0F) > 9 || bcd >= 0xA0) return 0;
+    return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+unsigned char rtc_bin_to_bcd(unsigned char bin) {
+    if (bin > 99) bin = 99;
+    return ((bin / 10) << 4) | (bin % 10);
+}
+
+unsigned char rtc_time_seconds(const RTC_Time *time) {
+    return rtc_bcd_to_bin(time->second);
+}
+
+void rtc_time_from_bcd(RTC_Time *time) {
+    unsigned char *field = &time->second;
+    unsigned char i;
+
+    for (i = 0; i < 6; i++) field[i] = rtc_bcd_to_bin(field[i]);
+}
+
+void rtc_time_to_bcd(RTC_Time *time) {
+    unsigned char *field = &time->second;
+    unsigned char i;
+
+    for (i = 0; i < 6; i++) field[i] = rtc_bin_to_bcd(field[i]);
+}
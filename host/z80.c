@@ -0,0 +1,825 @@
+// Z80 core for the CP/M emulator. Instructions are decoded from the
+// opcode fields (x = bits 7-6, y = 5-3, z = 2-0, p = y >> 1, q = y & 1),
+// and each one adds its T-states to cpu->tstates: 4 for every opcode
+// fetch (M1, which also steps R), the rest from the instruction itself.
+#include "z80.h"
+
+#define C_  Z80_C
+#define N_  Z80_N
+#define PV_ Z80_PV
+#define X_  Z80_X
+#define H_  Z80_H
+#define Y_  Z80_Y
+#define Z_  Z80_Z
+#define S_  Z80_S
+
+static uint8_t sz53[256];   // S, Z, Y and X of a result
+static uint8_t sz53p[256];  // The same and parity in PV
+static int ready;
+
+static void initTables(void) {
+    unsigned int i, bits;
+
+    for (i = 0; i < 256; i++) {
+        sz53[i] = (i & (S_ | Y_ | X_)) | (i == 0 ? Z_ : 0);
+        bits = ((i >> 0) ^ (i >> 1) ^ (i >> 2) ^ (i >> 3) ^
+                (i >> 4) ^ (i >> 5) ^ (i >> 6) ^ (i >> 7)) & 1;
+        sz53p[i] = sz53[i] | (bits ? 0 : PV_);
+    }
+    ready = 1;
+}
+
+void z80_reset(Z80 *cpu) {
+    if (!ready) initTables();
+    cpu->af = cpu->bc = cpu->de = cpu->hl = 0xFFFF;
+    cpu->af2 = cpu->bc2 = cpu->de2 = cpu->hl2 = 0xFFFF;
+    cpu->ix = cpu->iy = cpu->sp = 0xFFFF;
+    cpu->pc = 0;
+    cpu->i = cpu->r = 0;
+    cpu->iff1 = cpu->iff2 = cpu->im = 0;
+    cpu->halted = 0;
+    cpu->tstates = 0;
+}
+
+// Registers, memory and the stack
+
+static uint8_t getA(Z80 *cpu) { return cpu->af >> 8; }
+static uint8_t getF(Z80 *cpu) { return cpu->af & 0xFF; }
+static void setA(Z80 *cpu, uint8_t v) { cpu->af = (cpu->af & 0x00FF) | v << 8; }
+static void setF(Z80 *cpu, uint8_t v) { cpu->af = (cpu->af & 0xFF00) | v; }
+
+static uint8_t rd(Z80 *cpu, uint16_t addr) {
+    return cpu->mem[addr];
+}
+
+static void wr(Z80 *cpu, uint16_t addr, uint8_t v) {
+    cpu->mem[addr] = v;
+}
+
+static uint16_t rd16(Z80 *cpu, uint16_t addr) {
+    return rd(cpu, addr) | rd(cpu, (uint16_t)(addr + 1)) << 8;
+}
+
+static void wr16(Z80 *cpu, uint16_t addr, uint16_t v) {
+    wr(cpu, addr, v & 0xFF);
+    wr(cpu, (uint16_t)(addr + 1), v >> 8);
+}
+
+static uint8_t fetch(Z80 *cpu) {
+    return rd(cpu, cpu->pc++);
+}
+
+static uint16_t fetch16(Z80 *cpu) {
+    uint16_t v = rd16(cpu, cpu->pc);
+
+    cpu->pc += 2;
+    return v;
+}
+
+// An opcode fetch: M1 takes 4 T-states and steps the low 7 bits of R
+static uint8_t fetchOp(Z80 *cpu) {
+    cpu->r = (cpu->r & 0x80) | ((cpu->r + 1) & 0x7F);
+    cpu->tstates += 4;
+    return fetch(cpu);
+}
+
+static void push(Z80 *cpu, uint16_t v) {
+    cpu->sp -= 2;
+    wr16(cpu, cpu->sp, v);
+}
+
+static uint16_t pop(Z80 *cpu) {
+    uint16_t v = rd16(cpu, cpu->sp);
+
+    cpu->sp += 2;
+    return v;
+}
+
+void z80_ret(Z80 *cpu) {
+    cpu->pc = pop(cpu);
+    cpu->tstates += 10;
+}
+
+static uint8_t portIn(Z80 *cpu, uint16_t port) {
+    return cpu->port_in ? cpu->port_in(cpu->ctx, port) : 0xFF;
+}
+
+static void portOut(Z80 *cpu, uint16_t port, uint8_t v) {
+    if (cpu->port_out) cpu->port_out(cpu->ctx, port, v);
+}
+
+// HL, or IX or IY under a DD or FD prefix (idx 1 or 2)
+static uint16_t *indexReg(Z80 *cpu, int idx) {
+    return idx == 0 ? &cpu->hl : idx == 1 ? &cpu->ix : &cpu->iy;
+}
+
+// 8-bit register r (0-7: B C D E H L - A); H and L are the index
+// register halves under a prefix. (HL) is handled by the callers.
+static uint8_t getReg(Z80 *cpu, int r, int idx) {
+    switch (r) {
+    case 0: return cpu->bc >> 8;
+    case 1: return cpu->bc & 0xFF;
+    case 2: return cpu->de >> 8;
+    case 3: return cpu->de & 0xFF;
+    case 4: return *indexReg(cpu, idx) >> 8;
+    case 5: return *indexReg(cpu, idx) & 0xFF;
+    default: return getA(cpu);
+    }
+}
+
+static void setReg(Z80 *cpu, int r, int idx, uint8_t v) {
+    uint16_t *pair;
+
+    switch (r) {
+    case 0: cpu->bc = (cpu->bc & 0x00FF) | v << 8; break;
+    case 1: cpu->bc = (cpu->bc & 0xFF00) | v; break;
+    case 2: cpu->de = (cpu->de & 0x00FF) | v << 8; break;
+    case 3: cpu->de = (cpu->de & 0xFF00) | v; break;
+    case 4: pair = indexReg(cpu, idx); *pair = (*pair & 0x00FF) | v << 8; break;
+    case 5: pair = indexReg(cpu, idx); *pair = (*pair & 0xFF00) | v; break;
+    default: setA(cpu, v); break;
+    }
+}
+
+// Register pair p (0-3): BC DE HL SP, or AF for the last with PUSH/POP
+static uint16_t getPair(Z80 *cpu, int p, int idx, int af) {
+    switch (p) {
+    case 0: return cpu->bc;
+    case 1: return cpu->de;
+    case 2: return *indexReg(cpu, idx);
+    default: return af ? cpu->af : cpu->sp;
+    }
+}
+
+static void setPair(Z80 *cpu, int p, int idx, int af, uint16_t v) {
+    switch (p) {
+    case 0: cpu->bc = v; break;
+    case 1: cpu->de = v; break;
+    case 2: *indexReg(cpu, idx) = v; break;
+    default:
+        if (af) cpu->af = v;
+        else cpu->sp = v;
+        break;
+    }
+}
+
+// Address of the (HL) operand: HL, or IX/IY plus the displacement byte
+static uint16_t operandAddr(Z80 *cpu, int idx) {
+    int8_t d;
+
+    if (idx == 0) return cpu->hl;
+    d = (int8_t)fetch(cpu);
+    return (uint16_t)(*indexReg(cpu, idx) + d);
+}
+
+// Condition cc (0-7): NZ Z NC C PO PE P M
+static int condition(Z80 *cpu, int cc) {
+    uint8_t f = getF(cpu);
+
+    switch (cc) {
+    case 0: return !(f & Z_);
+    case 1: return (f & Z_) != 0;
+    case 2: return !(f & C_);
+    case 3: return (f & C_) != 0;
+    case 4: return !(f & PV_);
+    case 5: return (f & PV_) != 0;
+    case 6: return !(f & S_);
+    default: return (f & S_) != 0;
+    }
+}
+
+// Arithmetic
+
+// ALU operation y (0-7: ADD ADC SUB SBC AND XOR OR CP) on A and v
+static void alu(Z80 *cpu, int op, uint8_t v) {
+    unsigned int a = getA(cpu), r, carry = getF(cpu) & C_;
+    uint8_t f;
+
+    switch (op) {
+    case 0:
+    case 1:
+        r = a + v + (op == 1 ? carry : 0);
+        f = sz53[r & 0xFF] | ((r >> 8) & C_) | ((a ^ v ^ r) & H_) |
+            ((~(a ^ v) & (a ^ r) & 0x80) ? PV_ : 0);
+        setA(cpu, r);
+        break;
+    case 2:
+    case 3:
+    case 7:
+        r = a - v - (op == 3 ? carry : 0);
+        f = sz53[r & 0xFF] | N_ | ((r >> 8) & C_) | ((a ^ v ^ r) & H_) |
+            (((a ^ v) & (a ^ r) & 0x80) ? PV_ : 0);
+        if (op == 7) f = (f & ~(Y_ | X_)) | (v & (Y_ | X_));   // CP: from the operand
+        else setA(cpu, r);
+        break;
+    case 4:
+        r = a & v;
+        f = sz53p[r] | H_;
+        setA(cpu, r);
+        break;
+    case 5:
+        r = a ^ v;
+        f = sz53p[r];
+        setA(cpu, r);
+        break;
+    default:
+        r = a | v;
+        f = sz53p[r];
+        setA(cpu, r);
+        break;
+    }
+    setF(cpu, f);
+}
+
+static uint8_t inc8(Z80 *cpu, uint8_t v) {
+    uint8_t r = v + 1;
+
+    setF(cpu, (getF(cpu) & C_) | sz53[r] | ((v & 0x0F) == 0x0F ? H_ : 0) | (v == 0x7F ? PV_ : 0));
+    return r;
+}
+
+static uint8_t dec8(Z80 *cpu, uint8_t v) {
+    uint8_t r = v - 1;
+
+    setF(cpu, (getF(cpu) & C_) | N_ | sz53[r] | ((v & 0x0F) == 0 ? H_ : 0) | (v == 0x80 ? PV_ : 0));
+    return r;
+}
+
+static uint16_t add16(Z80 *cpu, uint16_t a, uint16_t v) {
+    uint32_t r = (uint32_t)a + v;
+
+    setF(cpu, (getF(cpu) & (S_ | Z_ | PV_)) | ((r >> 16) & C_) |
+         (((a ^ v ^ r) >> 8) & H_) | ((r >> 8) & (Y_ | X_)));
+    return r;
+}
+
+static uint16_t adc16(Z80 *cpu, uint16_t a, uint16_t v) {
+    uint32_t r = (uint32_t)a + v + (getF(cpu) & C_);
+
+    setF(cpu, ((r >> 8) & (S_ | Y_ | X_)) | ((r & 0xFFFF) ? 0 : Z_) |
+         (((a ^ v ^ r) >> 8) & H_) | ((~(a ^ v) & (a ^ r) & 0x8000) ? PV_ : 0) |
+         ((r >> 16) & C_));
+    return r;
+}
+
+static uint16_t sbc16(Z80 *cpu, uint16_t a, uint16_t v) {
+    uint32_t r = (uint32_t)a - v - (getF(cpu) & C_);
+
+    setF(cpu, ((r >> 8) & (S_ | Y_ | X_)) | ((r & 0xFFFF) ? 0 : Z_) |
+         (((a ^ v ^ r) >> 8) & H_) | (((a ^ v) & (a ^ r) & 0x8000) ? PV_ : 0) |
+         N_ | ((r >> 16) & C_));
+    return r;
+}
+
+static void daa(Z80 *cpu) {
+    uint8_t a = getA(cpu), f = getF(cpu), diff = 0, carry = f & C_, half, r;
+
+    if ((f & H_) || (a & 0x0F) > 9) diff = 0x06;
+    if (carry || a > 0x99) {
+        diff |= 0x60;
+        carry = C_;
+    }
+    if (f & N_) {
+        r = a - diff;
+        half = ((f & H_) && (a & 0x0F) < 6) ? H_ : 0;
+    } else {
+        r = a + diff;
+        half = (a & 0x0F) > 9 ? H_ : 0;
+    }
+    setA(cpu, r);
+    setF(cpu, sz53p[r] | half | carry | (f & N_));
+}
+
+// The accumulator rotates and flag operations (opcodes 07h-3Fh, z = 7)
+static void accumulatorOp(Z80 *cpu, int y) {
+    uint8_t a = getA(cpu), f = getF(cpu), carry;
+
+    switch (y) {
+    case 0:     // RLCA
+        carry = a >> 7;
+        a = (a << 1) | carry;
+        break;
+    case 1:     // RRCA
+        carry = a & 1;
+        a = (a >> 1) | (carry << 7);
+        break;
+    case 2:     // RLA
+        carry = a >> 7;
+        a = (a << 1) | (f & C_);
+        break;
+    case 3:     // RRA
+        carry = a & 1;
+        a = (a >> 1) | ((f & C_) << 7);
+        break;
+    case 4:
+        daa(cpu);
+        return;
+    case 5:     // CPL
+        a = ~a;
+        setA(cpu, a);
+        setF(cpu, (f & (S_ | Z_ | PV_ | C_)) | H_ | N_ | (a & (Y_ | X_)));
+        return;
+    case 6:     // SCF
+        setF(cpu, (f & (S_ | Z_ | PV_)) | C_ | (a & (Y_ | X_)));
+        return;
+    default:    // CCF
+        setF(cpu, (f & (S_ | Z_ | PV_)) | ((f & C_) ? H_ : C_) | (a & (Y_ | X_)));
+        return;
+    }
+    setA(cpu, a);
+    setF(cpu, (f & (S_ | Z_ | PV_)) | (a & (Y_ | X_)) | carry);
+}
+
+// CB rotate or shift y (0-7: RLC RRC RL RR SLA SRA SLL SRL)
+static uint8_t rotate(Z80 *cpu, int op, uint8_t v) {
+    uint8_t carry, r;
+
+    switch (op) {
+    case 0: carry = v >> 7; r = (v << 1) | carry; break;
+    case 1: carry = v & 1; r = (v >> 1) | (carry << 7); break;
+    case 2: carry = v >> 7; r = (v << 1) | (getF(cpu) & C_); break;
+    case 3: carry = v & 1; r = (v >> 1) | ((getF(cpu) & C_) << 7); break;
+    case 4: carry = v >> 7; r = v << 1; break;
+    case 5: carry = v & 1; r = (v >> 1) | (v & 0x80); break;
+    case 6: carry = v >> 7; r = (v << 1) | 1; break;
+    default: carry = v & 1; r = v >> 1; break;
+    }
+    setF(cpu, sz53p[r] | carry);
+    return r;
+}
+
+// BIT n: Y and X come from xy, the operand or the address high byte
+static void bit(Z80 *cpu, int n, uint8_t v, uint8_t xy) {
+    uint8_t f = (getF(cpu) & C_) | H_ | (xy & (Y_ | X_));
+
+    if (!(v & (1 << n))) f |= Z_ | PV_;
+    if (n == 7 && (v & 0x80)) f |= S_;
+    setF(cpu, f);
+}
+
+// Prefixed groups
+
+// CB xx: rotates, BIT, RES and SET on a register or (HL)
+static void execCB(Z80 *cpu) {
+    uint8_t op = fetchOp(cpu), v, r;
+    int x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+
+    if (z == 6) {
+        v = rd(cpu, cpu->hl);
+        if (x == 1) {
+            bit(cpu, y, v, cpu->hl >> 8);
+            cpu->tstates += 4;
+            return;
+        }
+        cpu->tstates += 7;
+    } else {
+        v = getReg(cpu, z, 0);
+        if (x == 1) {
+            bit(cpu, y, v, v);
+            return;
+        }
+    }
+
+    switch (x) {
+    case 0: r = rotate(cpu, y, v); break;
+    case 2: r = v & ~(1 << y); break;
+    default: r = v | (1 << y); break;
+    }
+    if (z == 6) wr(cpu, cpu->hl, r);
+    else setReg(cpu, z, 0, r);
+}
+
+// DD CB d xx / FD CB d xx: the same on (IX+d) or (IY+d). Apart from BIT,
+// the result is also copied to register z unless z is 6.
+static void execIndexCB(Z80 *cpu, int idx) {
+    uint16_t addr = operandAddr(cpu, idx);
+    uint8_t op = fetch(cpu), v = rd(cpu, addr), r;
+    int x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+
+    if (x == 1) {
+        bit(cpu, y, v, addr >> 8);
+        cpu->tstates += 12;
+        return;
+    }
+    switch (x) {
+    case 0: r = rotate(cpu, y, v); break;
+    case 2: r = v & ~(1 << y); break;
+    default: r = v | (1 << y); break;
+    }
+    wr(cpu, addr, r);
+    if (z != 6) setReg(cpu, z, 0, r);
+    cpu->tstates += 15;
+}
+
+// LDI, LDD, CPI, CPD, INI, IND, OUTI, OUTD and their repeats
+static void blockOp(Z80 *cpu, int y, int z) {
+    int step = (y & 1) ? -1 : 1, repeat = y >= 6;
+    uint8_t v, f = getF(cpu), a = getA(cpu), r, n, b;
+
+    switch (z) {
+    case 0:
+        v = rd(cpu, cpu->hl);
+        wr(cpu, cpu->de, v);
+        cpu->hl += step;
+        cpu->de += step;
+        cpu->bc--;
+        n = v + a;
+        setF(cpu, (f & (S_ | Z_ | C_)) | (cpu->bc ? PV_ : 0) | (n & X_) | ((n & 0x02) << 4));
+        repeat = repeat && cpu->bc != 0;
+        break;
+    case 1:
+        v = rd(cpu, cpu->hl);
+        r = a - v;
+        cpu->hl += step;
+        cpu->bc--;
+        f = (f & C_) | N_ | (sz53[r] & (S_ | Z_)) | ((a ^ v ^ r) & H_) | (cpu->bc ? PV_ : 0);
+        n = r - ((f & H_) ? 1 : 0);
+        setF(cpu, f | (n & X_) | ((n & 0x02) << 4));
+        repeat = repeat && cpu->bc != 0 && r != 0;
+        break;
+    case 2:
+        v = portIn(cpu, cpu->bc);
+        wr(cpu, cpu->hl, v);
+        cpu->hl += step;
+        b = (cpu->bc >> 8) - 1;
+        cpu->bc = (cpu->bc & 0x00FF) | b << 8;
+        setF(cpu, sz53[b] | N_);
+        repeat = repeat && b != 0;
+        break;
+    default:
+        v = rd(cpu, cpu->hl);
+        b = (cpu->bc >> 8) - 1;
+        cpu->bc = (cpu->bc & 0x00FF) | b << 8;
+        portOut(cpu, cpu->bc, v);
+        cpu->hl += step;
+        setF(cpu, sz53[b] | N_);
+        repeat = repeat && b != 0;
+        break;
+    }
+    cpu->tstates += 8;
+    if (repeat) {
+        cpu->pc -= 2;
+        cpu->tstates += 5;
+    }
+}
+
+// ED xx. Undefined opcodes are 8 T-state no-ops.
+static void execED(Z80 *cpu) {
+    uint8_t op = fetchOp(cpu), v, a;
+    int x = op >> 6, y = (op >> 3) & 7, z = op & 7, p = y >> 1, q = y & 1;
+    static const uint8_t modes[4] = {0, 0, 1, 2};
+
+    if (x == 2 && y >= 4 && z <= 3) {
+        blockOp(cpu, y, z);
+        return;
+    }
+    if (x != 1) return;
+
+    switch (z) {
+    case 0:     // IN r,(C); y = 6 only sets the flags
+        v = portIn(cpu, cpu->bc);
+        setF(cpu, (getF(cpu) & C_) | sz53p[v]);
+        if (y != 6) setReg(cpu, y, 0, v);
+        cpu->tstates += 4;
+        break;
+    case 1:     // OUT (C),r; y = 6 writes 0
+        portOut(cpu, cpu->bc, y == 6 ? 0 : getReg(cpu, y, 0));
+        cpu->tstates += 4;
+        break;
+    case 2:
+        if (q) cpu->hl = adc16(cpu, cpu->hl, getPair(cpu, p, 0, 0));
+        else cpu->hl = sbc16(cpu, cpu->hl, getPair(cpu, p, 0, 0));
+        cpu->tstates += 7;
+        break;
+    case 3:
+        if (q) setPair(cpu, p, 0, 0, rd16(cpu, fetch16(cpu)));
+        else wr16(cpu, fetch16(cpu), getPair(cpu, p, 0, 0));
+        cpu->tstates += 12;
+        break;
+    case 4:     // NEG
+        v = getA(cpu);
+        setA(cpu, 0);
+        alu(cpu, 2, v);
+        break;
+    case 5:     // RETN, RETI
+        cpu->pc = pop(cpu);
+        cpu->iff1 = cpu->iff2;
+        cpu->tstates += 6;
+        break;
+    case 6:
+        cpu->im = modes[y & 3];
+        break;
+    default:
+        switch (y) {
+        case 0: cpu->i = getA(cpu); cpu->tstates += 1; break;
+        case 1: cpu->r = getA(cpu); cpu->tstates += 1; break;
+        case 2:
+        case 3:
+            v = y == 2 ? cpu->i : cpu->r;
+            setA(cpu, v);
+            setF(cpu, (getF(cpu) & C_) | sz53[v] | (cpu->iff2 ? PV_ : 0));
+            cpu->tstates += 1;
+            break;
+        case 4:     // RRD
+        case 5:     // RLD
+            v = rd(cpu, cpu->hl);
+            a = getA(cpu);
+            if (y == 4) {
+                wr(cpu, cpu->hl, (a << 4) | (v >> 4));
+                a = (a & 0xF0) | (v & 0x0F);
+            } else {
+                wr(cpu, cpu->hl, (v << 4) | (a & 0x0F));
+                a = (a & 0xF0) | (v >> 4);
+            }
+            setA(cpu, a);
+            setF(cpu, (getF(cpu) & C_) | sz53p[a]);
+            cpu->tstates += 10;
+            break;
+        default:
+            break;
+        }
+        break;
+    }
+}
+
+// Unprefixed opcodes, or DD/FD ones with HL replaced by IX/IY (idx 1/2).
+// The T-states added are the instruction's less its opcode fetch; (IX+d)
+// operands add 8 (5 for LD (IX+d),n), the prefix fetch having added 4.
+static void execMain(Z80 *cpu, uint8_t op, int idx) {
+    int x = op >> 6, y = (op >> 3) & 7, z = op & 7, p = y >> 1, q = y & 1;
+    int extra = idx ? 8 : 0;
+    uint16_t *hl = indexReg(cpu, idx), addr, v16;
+    uint8_t v;
+    int8_t d;
+
+    switch (x) {
+    case 0:
+        switch (z) {
+        case 0:
+            switch (y) {
+            case 0:     // NOP
+                break;
+            case 1:     // EX AF,AF'
+                v16 = cpu->af;
+                cpu->af = cpu->af2;
+                cpu->af2 = v16;
+                break;
+            case 2:     // DJNZ d
+                d = (int8_t)fetch(cpu);
+                cpu->bc -= 0x100;
+                if (cpu->bc >> 8) {
+                    cpu->pc += d;
+                    cpu->tstates += 9;
+                } else {
+                    cpu->tstates += 4;
+                }
+                break;
+            case 3:     // JR d
+                d = (int8_t)fetch(cpu);
+                cpu->pc += d;
+                cpu->tstates += 8;
+                break;
+            default:    // JR cc,d
+                d = (int8_t)fetch(cpu);
+                if (condition(cpu, y - 4)) {
+                    cpu->pc += d;
+                    cpu->tstates += 8;
+                } else {
+                    cpu->tstates += 3;
+                }
+                break;
+            }
+            break;
+        case 1:
+            if (q) {
+                *hl = add16(cpu, *hl, getPair(cpu, p, idx, 0));
+                cpu->tstates += 7;
+            } else {
+                setPair(cpu, p, idx, 0, fetch16(cpu));
+                cpu->tstates += 6;
+            }
+            break;
+        case 2:
+            switch (p) {
+            case 0:
+            case 1:
+                addr = p ? cpu->de : cpu->bc;
+                if (q) setA(cpu, rd(cpu, addr));
+                else wr(cpu, addr, getA(cpu));
+                cpu->tstates += 3;
+                break;
+            case 2:
+                addr = fetch16(cpu);
+                if (q) *hl = rd16(cpu, addr);
+                else wr16(cpu, addr, *hl);
+                cpu->tstates += 12;
+                break;
+            default:
+                addr = fetch16(cpu);
+                if (q) setA(cpu, rd(cpu, addr));
+                else wr(cpu, addr, getA(cpu));
+                cpu->tstates += 9;
+                break;
+            }
+            break;
+        case 3:
+            setPair(cpu, p, idx, 0, getPair(cpu, p, idx, 0) + (q ? -1 : 1));
+            cpu->tstates += 2;
+            break;
+        case 4:
+        case 5:
+            if (y == 6) {
+                addr = operandAddr(cpu, idx);
+                v = rd(cpu, addr);
+                wr(cpu, addr, z == 4 ? inc8(cpu, v) : dec8(cpu, v));
+                cpu->tstates += 7 + extra;
+            } else {
+                v = getReg(cpu, y, idx);
+                setReg(cpu, y, idx, z == 4 ? inc8(cpu, v) : dec8(cpu, v));
+            }
+            break;
+        case 6:
+            if (y == 6) {
+                addr = operandAddr(cpu, idx);
+                wr(cpu, addr, fetch(cpu));
+                cpu->tstates += 6 + (idx ? 5 : 0);
+            } else {
+                setReg(cpu, y, idx, fetch(cpu));
+                cpu->tstates += 3;
+            }
+            break;
+        default:
+            accumulatorOp(cpu, y);
+            break;
+        }
+        break;
+
+    case 1:
+        if (y == 6 && z == 6) {
+            // HALT: nothing can end it without interrupts
+            cpu->pc--;
+            cpu->halted = 1;
+        } else if (z == 6) {
+            // LD r,(HL): r is the real H or L even under a prefix
+            setReg(cpu, y, 0, rd(cpu, operandAddr(cpu, idx)));
+            cpu->tstates += 3 + extra;
+        } else if (y == 6) {
+            addr = operandAddr(cpu, idx);
+            wr(cpu, addr, getReg(cpu, z, 0));
+            cpu->tstates += 3 + extra;
+        } else {
+            setReg(cpu, y, idx, getReg(cpu, z, idx));
+        }
+        break;
+
+    case 2:
+        if (z == 6) {
+            alu(cpu, y, rd(cpu, operandAddr(cpu, idx)));
+            cpu->tstates += 3 + extra;
+        } else {
+            alu(cpu, y, getReg(cpu, z, idx));
+        }
+        break;
+
+    default:
+        switch (z) {
+        case 0:     // RET cc
+            if (condition(cpu, y)) {
+                cpu->pc = pop(cpu);
+                cpu->tstates += 7;
+            } else {
+                cpu->tstates += 1;
+            }
+            break;
+        case 1:
+            if (!q) {
+                setPair(cpu, p, idx, 1, pop(cpu));
+                cpu->tstates += 6;
+                break;
+            }
+            switch (p) {
+            case 0:     // RET
+                cpu->pc = pop(cpu);
+                cpu->tstates += 6;
+                break;
+            case 1:     // EXX
+                v16 = cpu->bc; cpu->bc = cpu->bc2; cpu->bc2 = v16;
+                v16 = cpu->de; cpu->de = cpu->de2; cpu->de2 = v16;
+                v16 = cpu->hl; cpu->hl = cpu->hl2; cpu->hl2 = v16;
+                break;
+            case 2:     // JP (HL)
+                cpu->pc = *hl;
+                break;
+            default:    // LD SP,HL
+                cpu->sp = *hl;
+                cpu->tstates += 2;
+                break;
+            }
+            break;
+        case 2:     // JP cc,nn
+            addr = fetch16(cpu);
+            if (condition(cpu, y)) cpu->pc = addr;
+            cpu->tstates += 6;
+            break;
+        case 3:
+            switch (y) {
+            case 0:     // JP nn
+                cpu->pc = fetch16(cpu);
+                cpu->tstates += 6;
+                break;
+            case 2:     // OUT (n),A
+                v = fetch(cpu);
+                portOut(cpu, (uint16_t)(getA(cpu) << 8 | v), getA(cpu));
+                cpu->tstates += 7;
+                break;
+            case 3:     // IN A,(n)
+                v = fetch(cpu);
+                setA(cpu, portIn(cpu, (uint16_t)(getA(cpu) << 8 | v)));
+                cpu->tstates += 7;
+                break;
+            case 4:     // EX (SP),HL
+                v16 = rd16(cpu, cpu->sp);
+                wr16(cpu, cpu->sp, *hl);
+                *hl = v16;
+                cpu->tstates += 15;
+                break;
+            case 5:     // EX DE,HL - never IX or IY
+                v16 = cpu->de;
+                cpu->de = cpu->hl;
+                cpu->hl = v16;
+                break;
+            case 6:     // DI
+                cpu->iff1 = cpu->iff2 = 0;
+                break;
+            case 7:     // EI
+                cpu->iff1 = cpu->iff2 = 1;
+                break;
+            default:    // CB, taken by z80_step
+                break;
+            }
+            break;
+        case 4:     // CALL cc,nn
+            addr = fetch16(cpu);
+            if (condition(cpu, y)) {
+                push(cpu, cpu->pc);
+                cpu->pc = addr;
+                cpu->tstates += 13;
+            } else {
+                cpu->tstates += 6;
+            }
+            break;
+        case 5:
+            if (!q) {
+                push(cpu, getPair(cpu, p, idx, 1));
+                cpu->tstates += 7;
+            } else if (p == 0) {    // CALL nn; the prefixes are taken by z80_step
+                addr = fetch16(cpu);
+                push(cpu, cpu->pc);
+                cpu->pc = addr;
+                cpu->tstates += 13;
+            }
+            break;
+        case 6:
+            alu(cpu, y, fetch(cpu));
+            cpu->tstates += 3;
+            break;
+        default:    // RST
+            push(cpu, cpu->pc);
+            cpu->pc = y * 8;
+            cpu->tstates += 7;
+            break;
+        }
+        break;
+    }
+}
+
+int z80_step(Z80 *cpu) {
+    uint64_t start = cpu->tstates;
+    uint8_t op;
+    int idx = 0;
+
+    if (!ready) initTables();
+    if (cpu->halted) {
+        fetchOp(cpu);
+        cpu->pc--;
+        return 4;
+    }
+
+    op = fetchOp(cpu);
+    while (op == 0xDD || op == 0xFD) {
+        idx = op == 0xDD ? 1 : 2;
+        op = fetchOp(cpu);
+    }
+    if (op == 0xCB) {
+        if (idx) {
+            execIndexCB(cpu, idx);
+        } else {
+            execCB(cpu);
+        }
+    } else if (op == 0xED) {
+        execED(cpu);
+    } else {
+        execMain(cpu, op, idx);
+    }
+    return (int)(cpu->tstates - start);
+}
@@ -0,0 +1,46 @@
+#ifndef Z80CPU_H
+#define Z80CPU_H
+
+// Z80 core for the CP/M emulator (cpmemu.c). Every documented instruction
+// and the undocumented index register halves, DDCB register copies and
+// SLL are implemented, with the T-states of each instruction on a Z80
+// without wait states. There are no interrupts: EI and DI only set the
+// flip-flops, and a HALT stops the core.
+
+#include <stdint.h>
+
+typedef struct Z80 {
+    uint16_t af, bc, de, hl;
+    uint16_t af2, bc2, de2, hl2;    // Alternate set
+    uint16_t ix, iy, sp, pc;
+    uint8_t i, r;
+    uint8_t iff1, iff2, im;
+    uint8_t halted;
+    uint64_t tstates;               // T-states since reset
+    uint8_t mem[65536];
+    // I/O ports: the full 16-bit address is passed, as on the bus
+    void *ctx;
+    uint8_t (*port_in)(void *ctx, uint16_t port);
+    void (*port_out)(void *ctx, uint16_t port, uint8_t value);
+} Z80;
+
+// Flag bits in F
+#define Z80_C   0x01
+#define Z80_N   0x02
+#define Z80_PV  0x04
+#define Z80_X   0x08
+#define Z80_H   0x10
+#define Z80_Y   0x20
+#define Z80_Z   0x40
+#define Z80_S   0x80
+
+// Clear the registers and the T-state count; memory is left alone
+void z80_reset(Z80 *cpu);
+
+// Execute one instruction (with its prefixes). Returns its T-states.
+int z80_step(Z80 *cpu);
+
+// Return from a subroutine, as RET: for traps that stand in for one
+void z80_ret(Z80 *cpu);
+
+#endif // Z80CPU_H
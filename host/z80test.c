@@ -0,0 +1,206 @@
+// Checks of the Z80 core (make test runs it before the .COM tests): the
+// T-states of one instruction of each timing class, and the flags of the
+// ALU cases that are easy to get wrong. Exits non-zero on a failure.
+#include "z80.h"
+#include <stdio.h>
+#include <string.h>
+
+static Z80 cpu;
+static int failures;
+
+static void setup(void) {
+    z80_reset(&cpu);
+    cpu.sp = 0x8000;
+    cpu.hl = cpu.ix = cpu.iy = 0x4000;
+    cpu.bc = 0x0102;
+    cpu.de = 0x5000;
+    cpu.af = 0x0000;
+}
+
+// Run the instruction at 0100h, checking its T-states
+static void run(const char *name, const unsigned char *code, size_t size, int want) {
+    int t;
+
+    memcpy(cpu.mem + 0x100, code, size);
+    cpu.pc = 0x100;
+    t = z80_step(&cpu);
+    if (t != want) {
+        printf("FAIL %s: %d T-states, want %d\n", name, t, want);
+        failures++;
+    }
+}
+
+static void flags(const char *name, unsigned int a, unsigned int f) {
+    if ((cpu.af >> 8) != a || (cpu.af & 0xFF) != f) {
+        printf("FAIL %s: A=%02X F=%02X, want A=%02X F=%02X\n", name, cpu.af >> 8, cpu.af & 0xFF, a, f);
+        failures++;
+    }
+}
+
+// One instruction from the default registers
+#define T(name, want, ...) do { \
+    static const unsigned char code[] = {__VA_ARGS__}; \
+    setup(); \
+    run(name, code, sizeof(code), want); \
+} while (0)
+
+// Run the instructions in code from A and F, then check A and F
+static void check(const char *name, const unsigned char *code, size_t size,
+                  unsigned int af, unsigned int want_a, unsigned int want_f) {
+    setup();
+    memcpy(cpu.mem + 0x100, code, size);
+    cpu.af = af;
+    cpu.pc = 0x100;
+    while (cpu.pc < 0x100 + size) z80_step(&cpu);
+    flags(name, want_a, want_f);
+}
+
+#define ALU(name, af, want_a, want_f, ...) do { \
+    static const unsigned char code[] = {__VA_ARGS__}; \
+    check(name, code, sizeof(code), af, want_a, want_f); \
+} while (0)
+
+static void timing(void) {
+    static const unsigned char djnz[] = {0x10, 0xFE}, jrnz[] = {0x20, 0x00};
+    static const unsigned char retnz[] = {0xC0}, callnz[] = {0xC4, 0x00, 0x00}, ldir[] = {0xED, 0xB0};
+
+    T("NOP", 4, 0x00);
+    T("LD BC,nn", 10, 0x01, 0x01, 0x02);
+    T("LD (BC),A", 7, 0x02);
+    T("INC BC", 6, 0x03);
+    T("INC B", 4, 0x04);
+    T("LD B,n", 7, 0x06, 0x05);
+    T("RLCA", 4, 0x07);
+    T("ADD HL,BC", 11, 0x09);
+    T("JR d", 12, 0x18, 0x00);
+    T("JR NZ,d taken", 12, 0x20, 0x00);
+    T("LD (nn),HL", 16, 0x22, 0x00, 0x60);
+    T("LD A,(nn)", 13, 0x3A, 0x00, 0x60);
+    T("INC (HL)", 11, 0x34);
+    T("LD (HL),n", 10, 0x36, 0x01);
+    T("LD B,(HL)", 7, 0x46);
+    T("LD (HL),B", 7, 0x70);
+    T("LD B,C", 4, 0x41);
+    T("ADD A,(HL)", 7, 0x86);
+    T("RET NZ taken", 11, 0xC0);
+    T("POP BC", 10, 0xC1);
+    T("JP nn", 10, 0xC3, 0x00, 0x00);
+    T("CALL nn", 17, 0xCD, 0x00, 0x00);
+    T("PUSH BC", 11, 0xC5);
+    T("ADD A,n", 7, 0xC6, 0x01);
+    T("RST 08", 11, 0xCF);
+    T("RET", 10, 0xC9);
+    T("OUT (n),A", 11, 0xD3, 0x01);
+    T("IN A,(n)", 11, 0xDB, 0x01);
+    T("EX (SP),HL", 19, 0xE3);
+    T("JP (HL)", 4, 0xE9);
+    T("LD SP,HL", 6, 0xF9);
+    T("RLC B", 8, 0xCB, 0x00);
+    T("RLC (HL)", 15, 0xCB, 0x06);
+    T("BIT 0,(HL)", 12, 0xCB, 0x46);
+    T("SET 0,(HL)", 15, 0xCB, 0xC6);
+    T("LD IX,nn", 14, 0xDD, 0x21, 0x00, 0x00);
+    T("ADD IX,BC", 15, 0xDD, 0x09);
+    T("INC IX", 10, 0xDD, 0x23);
+    T("LD (nn),IX", 20, 0xDD, 0x22, 0x00, 0x60);
+    T("INC (IX+d)", 23, 0xDD, 0x34, 0x01);
+    T("LD (IX+d),n", 19, 0xDD, 0x36, 0x01, 0x02);
+    T("LD B,(IX+d)", 19, 0xDD, 0x46, 0x01);
+    T("ADD A,(IX+d)", 19, 0xDD, 0x86, 0x01);
+    T("PUSH IX", 15, 0xDD, 0xE5);
+    T("EX (SP),IX", 23, 0xDD, 0xE3);
+    T("JP (IX)", 8, 0xDD, 0xE9);
+    T("LD IXH,n", 11, 0xDD, 0x26, 0x01);
+    T("LD A,IXL", 8, 0xDD, 0x7D);
+    T("RLC (IX+d)", 23, 0xDD, 0xCB, 0x01, 0x06);
+    T("BIT 0,(IY+d)", 20, 0xFD, 0xCB, 0x01, 0x46);
+    T("IN B,(C)", 12, 0xED, 0x40);
+    T("SBC HL,BC", 15, 0xED, 0x42);
+    T("LD (nn),BC", 20, 0xED, 0x43, 0x00, 0x60);
+    T("NEG", 8, 0xED, 0x44);
+    T("RETN", 14, 0xED, 0x45);
+    T("IM 1", 8, 0xED, 0x56);
+    T("LD A,I", 9, 0xED, 0x57);
+    T("RLD", 18, 0xED, 0x6F);
+    T("LDI", 16, 0xED, 0xA0);
+    T("LDIR repeating", 21, 0xED, 0xB0);
+    T("CPI", 16, 0xED, 0xA1);
+
+    setup();
+    cpu.bc = 0x0200;
+    run("DJNZ taken", djnz, sizeof(djnz), 13);
+    setup();
+    run("DJNZ not taken", djnz, sizeof(djnz), 8);
+    setup();
+    cpu.af = Z80_Z;
+    run("JR NZ,d not taken", jrnz, sizeof(jrnz), 7);
+    setup();
+    cpu.af = Z80_Z;
+    run("RET NZ not taken", retnz, sizeof(retnz), 5);
+    setup();
+    cpu.af = Z80_Z;
+    run("CALL NZ,nn not taken", callnz, sizeof(callnz), 10);
+    setup();
+    cpu.bc = 1;
+    run("LDIR last", ldir, sizeof(ldir), 16);
+}
+
+static void arithmetic(void) {
+    static const unsigned char sbc[] = {0xED, 0x42}, rlc[] = {0xDD, 0xCB, 0x02, 0x00};
+    static const unsigned char ldh[] = {0xDD, 0x66, 0x01}, exde[] = {0xDD, 0xEB};
+
+    ALU("ADD A 7F+1", 0x7F00, 0x80, 0x94, 0xC6, 0x01);
+    ALU("ADC A FE+1+C", 0xFE01, 0x00, 0x51, 0xCE, 0x01);
+    ALU("SUB 0-1", 0x0000, 0xFF, 0xBB, 0xD6, 0x01);
+    ALU("CP 5,5", 0x0500, 0x05, 0x42, 0xFE, 0x05);
+    ALU("AND F0,0F", 0xF000, 0x00, 0x54, 0xE6, 0x0F);
+    ALU("INC A FF", 0xFF01, 0x00, 0x51, 0x3C);
+    ALU("RLA 80", 0x8000, 0x00, 0x01, 0x17);
+    ALU("NEG 80", 0x8000, 0x80, 0x87, 0xED, 0x44);
+    ALU("DAA 15+27", 0x1500, 0x42, 0x14, 0xC6, 0x27, 0x27);
+    ALU("DAA 10-08", 0x1000, 0x02, 0x02, 0xD6, 0x08, 0x27);
+    ALU("DAA 9A", 0x9A00, 0x00, 0x55, 0x27);
+
+    // SBC HL: 0 - 1 = FFFF with S, H, N and C
+    setup();
+    cpu.hl = 0;
+    cpu.bc = 1;
+    run("SBC HL,BC", sbc, sizeof(sbc), 15);
+    flags("SBC HL,BC", 0x00, 0xBB);
+    if (cpu.hl != 0xFFFF) {
+        printf("FAIL SBC HL,BC: HL=%04X, want FFFF\n", cpu.hl);
+        failures++;
+    }
+
+    // DDCB results are also copied to the register
+    setup();
+    cpu.mem[0x4002] = 0x81;
+    run("RLC (IX+2),B", rlc, sizeof(rlc), 23);
+    if (cpu.mem[0x4002] != 0x03 || cpu.bc >> 8 != 0x03) {
+        printf("FAIL RLC (IX+2),B: (IX+2)=%02X B=%02X, want 03 03\n", cpu.mem[0x4002], cpu.bc >> 8);
+        failures++;
+    }
+
+    // With (IX+d) the other operand is the real H; EX DE,HL ignores DD
+    setup();
+    cpu.mem[0x4001] = 0x77;
+    run("LD H,(IX+1)", ldh, sizeof(ldh), 19);
+    if (cpu.hl != 0x7700 || cpu.ix != 0x4000) {
+        printf("FAIL LD H,(IX+1): HL=%04X IX=%04X, want 7700 4000\n", cpu.hl, cpu.ix);
+        failures++;
+    }
+    setup();
+    cpu.de = 0x1111;
+    run("DD EX DE,HL", exde, sizeof(exde), 8);
+    if (cpu.hl != 0x1111 || cpu.ix != 0x4000) {
+        printf("FAIL DD EX DE,HL: HL=%04X IX=%04X, want 1111 4000\n", cpu.hl, cpu.ix);
+        failures++;
+    }
+}
+
+int main(void) {
+    timing();
+    arithmetic();
+    printf("Z80 core: %d failures\n", failures);
+    return failures != 0;
+}
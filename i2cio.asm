@@ -0,0 +1,47 @@
+	PUBLIC	_i2c_port_out, _i2c_port_in, _i2c_latch
+
+	SECTION code_user
+
+; RC2014 bit-banged I2C port (SC126/SC137): bit 0 SCL, bit 7 SDA
+I2C_PORT	EQU	0Ch
+
+; Latch bits not driven by ds3231.c. They belong to whatever else shares
+; the port and are kept from the shadow.
+I2C_KEEP	EQU	7Eh
+
+; The port reads back as the bus lines, not as written, and HBIOS does not
+; hand out its own shadow of it, so the first write sets the kept bits to
+; this value: SCL and SDA released and the rest clear, the state with
+; nothing else on the latch. On a board where another device shares port
+; 0Ch, set it to that board's RomWBW default (RTCDEF).
+I2C_LATCH_INIT	EQU	81h
+
+;
+; Write SCL and SDA, keeping the other latch bits from the shadow.
+; The latch cannot be read back, so the last value written is kept in
+; _i2c_latch, as RomWBW does.
+; void i2c_port_out(unsigned char value) __z88dk_fastcall
+;
+_i2c_port_out:
+	LD	A, (_i2c_latch)
+	XOR	L
+	AND	I2C_KEEP		; Kept bits: shadow XOR value
+	XOR	L			; Kept bits from the shadow, SCL/SDA from value
+	LD	(_i2c_latch), A
+	OUT	(I2C_PORT), A
+	RET
+
+;
+; Read the I2C port - bit 7 is the SDA line
+; unsigned char i2c_port_in(void)
+;
+_i2c_port_in:
+	IN	A, (I2C_PORT)
+	LD	L, A
+	LD	H, 0
+	RET
+
+	SECTION data_user
+
+; Last value written to the latch
+_i2c_latch:	DB	I2C_LATCH_INIT
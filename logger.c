@@ -0,0 +1,108 @@
+#include "logger.h"
+#include <string.h>
+
+LogFile *log_text;
+
+void initFcb(CPM_FCB *fcb, char *name, char *ext) {
+    unsigned char i;
+    
+    memset(fcb, 0, sizeof(CPM_FCB));
+    for (i = 0; i < 8; i++) fcb->name[i] = *name ? *name++ : ' ';
+    for (i = 0; i < 3; i++) fcb->ext[i] = *ext ? *ext++ : ' ';
+}
+
+int parseFileName(CPM_FCB *fcb, char *spec) {
+    char name[9], ext[4];
+    unsigned char drive = 0;
+    unsigned char i;
+    
+    if (spec[0] != '\0' && spec[1] == ':') {
+        drive = (spec[0] & 0x5F) - 'A' + 1;
+        if (drive < 1 || drive > 16) return 0;
+        spec += 2;
+    }
+    for (i = 0; i < 8 && *spec && *spec != '.'; i++) name[i] = *spec++;
+    name[i] = '\0';
+    if (*spec == '.') spec++;
+    for (i = 0; i < 3 && *spec && *spec != '.'; i++) ext[i] = *spec++;
+    ext[i] = '\0';
+    if (name[0] == '\0' || *spec != '\0') return 0;
+    
+    initFcb(fcb, name, ext);
+    fcb->drive = drive;
+    return 1;
+}
+
+// Write the oldest buffered record
+void logWriteTail(LogFile *log) {
+    log->fcb.r0 = log->record & 0xFF;
+    log->fcb.r1 = log->record >> 8;
+    log->fcb.r2 = 0;
+    cpm_set_dma(log->buf[log->tail]);
+    if (cpm_write_rand(&log->fcb) != 0) log->error = 1;
+    log->record++;
+    log->tail = (log->tail + 1) % LOG_RECORDS;
+}
+
+int logOpen(LogFile *log, char *spec, unsigned char text) {
+    memset(log, 0, sizeof(LogFile));
+    if (!parseFileName(&log->fcb, spec)) return 0;
+    cpm_delete(&log->fcb);
+    parseFileName(&log->fcb, spec);
+    if (cpm_make(&log->fcb) == CPM_DIR_ERROR) return 0;
+    log->pad = text ? 0x1A : 0;
+    log->open = 1;
+    return 1;
+}
+
+void logPut(LogFile *log, void *data, unsigned int size) {
+    unsigned char *p = data;
+    unsigned char part;
+    
+    while (size != 0) {
+        part = CPM_RECORD - log->len;
+        if (part > size) part = size;
+        memcpy(log->buf[log->head] + log->len, p, part);
+        p += part;
+        size -= part;
+        log->len += part;
+        if (log->len == CPM_RECORD) {
+            log->head = (log->head + 1) % LOG_RECORDS;
+            log->len = 0;
+            if (log->head == log->tail) logWriteTail(log);  // Ring full
+        }
+    }
+}
+
+void logNumber(LogFile *log, unsigned long value, unsigned char places) {
+    char text[12];
+    unsigned char i = sizeof(text);
+    
+    do {
+        if (places != 0 && i == sizeof(text) - places) text[--i] = '.';
+        text[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0 || i > sizeof(text) - places - 1);
+    logPut(log, text + i, sizeof(text) - i);
+}
+
+void logFlush(LogFile *log) {
+    while (log->tail != log->head) logWriteTail(log);
+}
+
+int logClose(LogFile *log) {
+    if (!log->open) return 1;
+    if (log->len != 0) {
+        memset(log->buf[log->head] + log->len, log->pad, CPM_RECORD - log->len);
+        log->head = (log->head + 1) % LOG_RECORDS;
+        log->len = 0;
+    }
+    logFlush(log);
+    if (cpm_close(&log->fcb) == CPM_DIR_ERROR) log->error = 1;
+    log->open = 0;
+    return !log->error;
+}
+
+void logTextChar(char ch) {
+    logPut(log_text, &ch, 1);
+}
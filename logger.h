@@ -0,0 +1,46 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "cpm.h"
+
+// Buffered output file. Bytes are packed into a ring of CPM_RECORD-sized
+// records in RAM and only whole records are written: by logFlush(), or by
+// logPut() when the ring is full. Measurement code appends and flushes
+// right after a gate has ended on an edge, so the disk is never touched
+// inside a timing window and the writes fall in the following gate's
+// wait for its first edge.
+#define LOG_RECORDS 4
+
+typedef struct {
+    CPM_FCB fcb;
+    unsigned char buf[LOG_RECORDS][CPM_RECORD];
+    unsigned char head;         // Ring slot being filled
+    unsigned char tail;         // Oldest slot not yet written
+    unsigned char len;          // Bytes in the head slot
+    unsigned char pad;          // Fill for the last record: ^Z for text
+    unsigned int record;        // File record of the tail slot
+    unsigned char error;        // A write failed
+    unsigned char open;
+} LogFile;
+
+// Fill in an FCB for NAME.EXT, or from "[d:]NAME.EXT" (1 if valid)
+void initFcb(CPM_FCB *fcb, char *name, char *ext);
+int parseFileName(CPM_FCB *fcb, char *spec);
+
+// Create (or replace) a log file. Text logs end with ^Z padding,
+// binary ones with zeros. Returns 1 on success.
+int logOpen(LogFile *log, char *spec, unsigned char text);
+void logPut(LogFile *log, void *data, unsigned int size);
+// Append value as decimal text; with places > 0 the lowest places digits
+// go after a decimal point (12345, 3 gives "12.345")
+void logNumber(LogFile *log, unsigned long value, unsigned char places);
+// Write the whole records buffered so far
+void logFlush(LogFile *log);
+// Pad, write and close. Returns 1 if every write succeeded.
+int logClose(LogFile *log);
+
+// Route printed text into a log (con_copy target, see console.h)
+extern LogFile *log_text;
+void logTextChar(char ch);
+
+#endif // LOGGER_H
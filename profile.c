@@ -0,0 +1,72 @@
+#include "profile.h"
+#include "cpm.h"
+#include <string.h>
+
+CPM_FCB profile_fcb;
+unsigned char profile_buf[CPM_RECORD];
+
+// Record number of the current RTC
+unsigned int profileRecord(void) {
+    if (rtc == &hbios_backend) return hbios_rtc_unit;
+    return rtc == &ds1302_backend ? RTC_MAX_UNITS : RTC_MAX_UNITS + 1;
+}
+
+// Byte sum of the record buffer, 0 when the checksum matches
+unsigned char profileSum(void) {
+    unsigned char sum = 0;
+    unsigned char i;
+    
+    for (i = 0; i < CPM_RECORD; i++) sum += profile_buf[i];
+    return sum;
+}
+
+// Read or write the current RTC's record through profile_buf.
+// Writing creates the file if needed. Returns 1 on success.
+int profileRecordIo(int write) {
+    unsigned int record = profileRecord();
+    int status;
+    
+    memset(&profile_fcb, 0, sizeof(CPM_FCB));
+    memcpy(profile_fcb.name, PROFILE_FILE_NAME "  " PROFILE_FILE_EXT, 11);
+    if (cpm_open(&profile_fcb) == CPM_DIR_ERROR) {
+        if (!write || cpm_make(&profile_fcb) == CPM_DIR_ERROR) return 0;
+    }
+    profile_fcb.r0 = record;
+    cpm_set_dma(profile_buf);
+    status = write ? cpm_write_rand(&profile_fcb) : cpm_read_rand(&profile_fcb);
+    if (cpm_close(&profile_fcb) == CPM_DIR_ERROR) return 0;
+    return status == 0;
+}
+
+RTC_Profile *profileLoad(void) {
+    RTC_Profile *profile = (RTC_Profile *)profile_buf;
+    
+    if (!profileRecordIo(0) ||
+        memcmp(profile->magic, PROFILE_MAGIC, 6) != 0 ||
+        profile->version != PROFILE_VERSION ||
+        profile->backend != rtc->name[0] ||
+        profile->record != profileRecord() ||
+        profileSum() != 0) {
+        return 0;
+    }
+    return profile;
+}
+
+RTC_Profile *profileEdit(void) {
+    RTC_Profile *profile = profileLoad();
+    
+    if (profile) return profile;
+    profile = (RTC_Profile *)profile_buf;
+    memset(profile_buf, 0, CPM_RECORD);
+    memcpy(profile->magic, PROFILE_MAGIC, 6);
+    profile->version = PROFILE_VERSION;
+    profile->backend = rtc->name[0];
+    profile->record = profileRecord();
+    return profile;
+}
+
+int profileSave(void) {
+    profile_buf[CPM_RECORD - 1] = 0;
+    profile_buf[CPM_RECORD - 1] = -profileSum();
+    return profileRecordIo(1);
+}
@@ -0,0 +1,42 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "rtc.h"
+#include "cpm.h"
+#include <stdint.h>
+
+// RTCCAL.DAT: the stored calibration of each RTC, one 128-byte record per
+// RTC (HBIOS units 0 to RTC_MAX_UNITS - 1, the DS1302, then the I2C
+// clock), so startup reads a single record. The last byte of a record
+// makes its byte sum 0. Figures are fixed point and fixed width so the
+// layout depends neither on the float format nor on the compiler.
+#define PROFILE_FILE_NAME "RTCCAL"
+#define PROFILE_FILE_EXT  "DAT"
+#define PROFILE_MAGIC     "RTCCAL"
+#define PROFILE_VERSION   1
+
+typedef struct {
+    char magic[6];              // PROFILE_MAGIC
+    unsigned char version;      // PROFILE_VERSION
+    char backend;               // First letter of the RTC backend name
+    unsigned char record;       // Own record number, as a check
+    unsigned char reserved;
+    uint16_t samples;           // Readings behind the estimate, 0 = none yet
+    int32_t ppm_milli;          // RTC error in 1/1000 ppm, + = RTC fast
+    uint32_t error_milli;       // +/- of the estimate, 1/1000 ppm
+    uint32_t cpu_hz;            // CPU clock it was measured against
+    RTC_Time calibrated;        // RTC time (BCD) of the calibration
+    RTC_Time set;               // RTC time (BCD) it was last set, 0 = unknown
+} RTC_Profile;
+
+// Fails to compile if the record outgrows CPM_RECORD less the checksum
+typedef char profile_size_check[sizeof(RTC_Profile) < CPM_RECORD ? 1 : -1];
+
+// The current RTC's record, or 0 if there is no valid one
+RTC_Profile *profileLoad(void);
+// The current RTC's record to update: the stored one, or a new empty one
+RTC_Profile *profileEdit(void);
+// Write back the record from profileLoad() or profileEdit(); 1 on success
+int profileSave(void);
+
+#endif // PROFILE_H
@@ -1,11 +1,15 @@
 	PUBLIC	_hbios_rtc_detect, _hbios_rtc_get_time, _hbios_rtc_set_time, _hbios_rtc_test
+	PUBLIC	_hbios_rtc_poll, _hbios_rtc_read, _hbios_rtc_write, _rtc_gate
+	PUBLIC	_rtc_gate_units
+	PUBLIC	_rtc_bcd_to_bin, _rtc_bin_to_bcd, _rtc_time_seconds
+	PUBLIC	_rtc_time_from_bcd, _rtc_time_to_bcd
+	PUBLIC	_hbios_rtc_unit
 
 	SECTION code_user
 
-; HBIOS RTC function constants
-BF_RTC		EQU	20h		; RTC get time function
-BF_RTCSET	EQU	21h		; RTC set time function
+	INCLUDE	"hbios.inc"
 
+RTC_UNIT_SIZE	EQU	18		; sizeof(RTC_UnitRecord), for rtc_gate_units
 
 ;
 ; Detect RTC presence by attempting to get time
@@ -16,22 +20,14 @@ _hbios_rtc_detect:
 	PUSH	BC
 	PUSH	DE
 	
-	; Try to get time to test RTC presence (with unit 0)
-	LD	B, 20h			; HBIOS RTC get time function
-	LD	D, 0			; Unit 0
-	LD	HL, TIME_BUF_DETECT	; Point to dedicated detect buffer
-	RST	08			; Call HBIOS via RST
+	; Try to get time to test RTC presence
+	CALL	_rtc_read_stack
 	
 	; Check result - A contains error code (0 = success)
-	OR	A			; Test A for zero
-	JR	Z, _detect_success	; Jump if successful (A=0)
-	
-	; RTC not available or error
 	LD	HL, 0			; Return 0 (not detected)
-	JR	_detect_exit
-	
-_detect_success:
-	LD	HL, 1			; Return 1 (detected)
+	OR	A			; Test A for zero
+	JR	NZ, _detect_exit	; Jump if RTC not available or error
+	INC	L			; Return 1 (detected)
 	
 _detect_exit:
 	POP	DE
@@ -39,146 +35,656 @@ _detect_exit:
 	RET
 
 ;
-; Get time from HBIOS RTC - SIMPLIFIED VERSION
-; int hbios_rtc_get_time(RTC_Time *time)
+; Read the selected unit into a buffer on the stack, then drop it
+; Returns: A = HBIOS status, E = BCD seconds
+; Destroys BC, D, HL
+;
+_rtc_read_stack:
+	LD	HL, -6			; Buffer below the return address
+	ADD	HL, SP
+	LD	SP, HL
+	LD	B, BF_RTC		; HBIOS RTC get time function
+	LD	A, (_hbios_rtc_unit)	; Selected unit, in C and D
+	LD	C, A
+	LD	D, A
+	RST	08			; Call HBIOS via RST
+	POP	BC			; YY MM
+	POP	BC			; DD HH
+	POP	DE			; E = MM, D = SS
+	LD	E, D
+	RET
+
+;
+; Read an HBIOS RTC straight into the caller's buffer
+; int hbios_rtc_read(RTC_HbiosTime *buf) __z88dk_fastcall
+; HL points to RTC_HbiosTime: +0 YY MM DD HH MM SS (BCD, HBIOS order),
+; +6 unit
+; Returns: HBIOS status (B8h still returns the time)
+;
+; Nothing is kept in static storage, so readers of different units do
+; not share a buffer.
+;
+_hbios_rtc_read:
+	LD	B, BF_RTC		; HBIOS RTC get time function
+	JR	_rtc_buf_call
+
+;
+; Set an HBIOS RTC from the caller's buffer (same layout as above)
+; int hbios_rtc_write(const RTC_HbiosTime *buf) __z88dk_fastcall
+; Returns: HBIOS status
+;
+_hbios_rtc_write:
+	LD	B, BF_RTCSET		; HBIOS RTC set time function
+	
+_rtc_buf_call:
+	PUSH	BC
+	PUSH	DE
+	PUSH	HL
+	LD	DE, 6
+	ADD	HL, DE
+	LD	C, (HL)			; The buffer's unit, in C and D
+	LD	D, C
+	POP	HL
+	RST	08			; Call HBIOS via RST
+	LD	L, A			; Return HBIOS status
+	LD	H, 0
+	POP	DE
+	POP	BC
+	RET
+
+;
+; Get time from HBIOS RTC
+; int hbios_rtc_get_time(RTC_Time *time) __z88dk_fastcall
 ; HL points to RTC_Time structure
-; Returns: 0 on success, -1 on error
+; Returns: HBIOS status (B8h still returns the time)
+;
+; HBIOS writes straight into the structure in its own order, which is
+; then reversed in place:
+; HBIOS: [0]=YY [1]=MM [2]=DD [3]=HH [4]=MM [5]=SS
+; Our:   [0]=SS [1]=MM [2]=HH [3]=DD [4]=MM [5]=YY
 ;
 _hbios_rtc_get_time:
 	PUSH	BC
 	PUSH	DE
 	
-	; Save structure pointer in DE
-	LD	D, H
-	LD	E, L
-	
-	; Call HBIOS exactly like the test function
-	LD	B, 20h			; HBIOS RTC get time function
-	LD	HL, TIME_BUF_GET	; Point to dedicated get buffer
-	PUSH	DE			; Save structure pointer on stack
-	LD	D, 0			; Unit 0
+	PUSH	HL			; Save structure pointer
+	LD	B, BF_RTC		; HBIOS RTC get time function
+	LD	A, (_hbios_rtc_unit)	; Selected unit, in C and D
+	LD	C, A
+	LD	D, A
 	RST	08			; Call HBIOS via RST
+	POP	HL			; Structure, first byte
+	PUSH	AF			; Save the HBIOS status
 	
-	; Save the HBIOS return code in C
-	LD	C, A			; Save return code in C
+	LD	D, H
+	LD	E, L
+	LD	BC, 5
+	EX	DE, HL
+	ADD	HL, BC
+	EX	DE, HL			; DE = last byte
+	LD	B, 3			; Three swaps
+_get_time_swap:
+	LD	A, (DE)
+	LD	C, (HL)
+	LD	(HL), A
+	LD	A, C
+	LD	(DE), A
+	INC	HL
+	DEC	DE
+	DJNZ	_get_time_swap
 	
-	; Get structure pointer back
-	POP	HL			; HL now points to structure
+	POP	AF			; Return the HBIOS status
+	LD	L, A
+	LD	H, 0
 	
-	; Copy HBIOS data directly to structure
-	; HBIOS: [0]=YY [1]=MM [2]=DD [3]=HH [4]=MM [5]=SS
-	; Our:   [0]=SS [1]=MM [2]=HH [3]=DD [4]=MM [5]=YY
+	POP	DE
+	POP	BC
+	RET
+
+;
+; Read the RTC seconds through HBIOS - the seconds-only fast path, used as
+; the gate poll routine and wherever only the seconds are wanted. The
+; buffer HBIOS needs lives on the stack for the call.
+; int hbios_rtc_poll(void)
+; Returns: BCD seconds in L with H = 0, or H = 1 and the HBIOS error in L
+; Destroys BC, DE
+;
+; _rtc_poll_unit is the same read of the unit in A (for rtc_gate_units).
+;
+_hbios_rtc_poll:
+	LD	A, (_hbios_rtc_unit)	; Selected unit
+_rtc_poll_unit:
+	LD	HL, -6			; Buffer on the stack
+	ADD	HL, SP
+	LD	SP, HL
+	LD	B, BF_RTC		; HBIOS RTC get time function
+	LD	C, A			; Unit in C and D
+	LD	D, A
+	RST	08			; Call HBIOS via RST
+	POP	BC			; Drop YY MM
+	POP	BC			; Drop DD HH
+	POP	DE			; D = seconds (HBIOS byte 5)
+	OR	A			; Test A for zero
+	JR	Z, _poll_ok
+	CP	0B8h			; Tolerated status, as elsewhere
+	JR	NZ, _poll_error
+_poll_ok:
+	LD	L, D
+	LD	H, 0
+	RET
+_poll_error:
+	LD	L, A			; Return HBIOS code
+	LD	H, 1
+	RET
+
+;
+; Count RTC polls between second edges
+; int rtc_gate(RTC_Gate *gate) __z88dk_fastcall
+; HL points to RTC_Gate: +0 seconds (word), +2 spin (byte), +3 polls (long),
+; +7 poll routine (word), +9 marks (word), +11 idle (word)
+; Returns: 0 on success, the poll routine's error code, or 100h if the RTC
+; stops ticking
+;
+; The poll routine takes no arguments and returns the BCD seconds in L with
+; H = 0, or an error code in L with H <> 0. It may destroy AF, BC, DE, HL.
+;
+; Waits for a seconds edge, then polls until gate->seconds more edges have
+; passed and stores the number of polls in gate->polls. If gate->marks is
+; not 0, the polls of each second are stored there (one word per second,
+; FFFFh if there were more).
+; After every edge, including the one the gate starts on, the gate idles
+; for gate->idle units of RTC_IDLE_TSTATES before polling again, so a
+; caller that knows roughly when the next edge is due can skip most of the
+; HBIOS calls in between.
+;
+; Every poll runs the same instructions except for the rare paths (edge
+; found, carry into the high word), so one poll costs a fixed number of
+; T-states: RTC_POLL_TSTATES of our own code, the poll routine, and 13
+; T-states per spin pass (RTC_SPIN_TSTATES). Timing two gates with
+; different spin counts cancels the unknown poll routine cost.
+;
+; Poll timing (T-states, common path):
+;	spin setup + DJNZ exit	 29 + 13 * spin
+;	poll call and dispatch	 37, then the poll routine
+;	status check		 19
+;	32-bit count		 53
+;	edge compare		 33
+;	total			171 + 13 * spin + poll routine
+;
+; The edge path is fixed length too. It adds RTC_EDGE_TSTATES (418) plus
+; the idle units to the poll that sees the edge, the same in every second
+; of every gate.
+;
+_rtc_gate:
+	PUSH	BC
+	PUSH	DE
 	
-	; Copy seconds (HBIOS byte 5 -> our byte 0)
-	LD	A, (TIME_BUF_GET+5)
-	LD	(HL), A
+	; Copy parameters and clear the count
+	LD	(GATE_PTR), HL		; Save structure pointer
+	LD	E, (HL)
 	INC	HL
-	
-	; Copy minutes (HBIOS byte 4 -> our byte 1)
-	LD	A, (TIME_BUF_GET+4)
-	LD	(HL), A
+	LD	D, (HL)
 	INC	HL
-	
-	; Copy hours (HBIOS byte 3 -> our byte 2)
-	LD	A, (TIME_BUF_GET+3)
-	LD	(HL), A
+	LD	(GATE_EDGES), DE	; Edges still to go
+	LD	A, (HL)
 	INC	HL
-	
-	; Copy date (HBIOS byte 2 -> our byte 3)
-	LD	A, (TIME_BUF_GET+2)
-	LD	(HL), A
+	LD	(GATE_SPIN), A		; Spin passes per poll
+	INC	HL			; Skip polls
 	INC	HL
-	
-	; Copy month (HBIOS byte 1 -> our byte 4)
-	LD	A, (TIME_BUF_GET+1)
-	LD	(HL), A
 	INC	HL
-	
-	; Copy year (HBIOS byte 0 -> our byte 5)
-	LD	A, (TIME_BUF_GET+0)
-	LD	(HL), A
-	
-	; Return the original HBIOS code for debugging
-	LD	L, C			; Return HBIOS code from C
-	LD	H, 0			; Clear high byte
-	
-_get_time_exit:
+	INC	HL
+	LD	E, (HL)
+	INC	HL
+	LD	D, (HL)
+	INC	HL
+	LD	(GATE_POLL_FN), DE	; Poll routine
+	LD	E, (HL)
+	INC	HL
+	LD	D, (HL)
+	INC	HL
+	LD	C, (HL)
+	INC	HL
+	LD	B, (HL)
+	LD	(GATE_IDLE), BC		; Idle units after each edge
+	LD	HL, 2			; Marks advance a word per edge
+	LD	A, D
+	OR	E
+	JR	NZ, _gate_marks
+	LD	DE, GATE_SCRATCH	; No marks: overwrite a dummy instead
+	LD	L, 0
+_gate_marks:
+	LD	(GATE_MARKS), DE
+	LD	(GATE_STRIDE), HL
+	LD	HL, 0
+	LD	(GATE_POLLS), HL
+	LD	(GATE_POLLS+2), HL
+	LD	(GATE_EDGE), HL
+	LD	(GATE_EDGE+2), HL
+	
+	; Read the starting second
+	CALL	_gate_call
+	LD	A, H
+	OR	A
+	JR	NZ, _gate_poll_err
+	LD	A, L
+	LD	(GATE_LAST), A
+	
+	; Wait for the next edge (not counted)
+	LD	BC, 0			; Timeout: 65536 reads
+_gate_sync:
+	PUSH	BC
+	CALL	_gate_call
+	POP	BC
+	LD	A, H
+	OR	A
+	JR	NZ, _gate_poll_err
+	LD	A, L
+	LD	HL, GATE_LAST
+	CP	(HL)
+	JR	NZ, _gate_start
+	DEC	BC
+	LD	A, B
+	OR	C
+	JR	NZ, _gate_sync
+	
+_gate_stall:
+	LD	HL, 100h		; Return 100h (RTC not ticking)
+	JR	_gate_exit
+	
+_gate_poll_err:
+	LD	H, 0			; Return the error code from L
+	
+_gate_exit:
 	POP	DE
 	POP	BC
 	RET
+	
+_gate_start:
+	LD	(HL), A			; New second is the reference
+	
+	; Pad the sync poll's 65 T-state tail to the 523 of a counting poll
+	; that sees an edge (105 + RTC_EDGE_TSTATES), so the first counted
+	; second is timed like the others
+	LD	B, 29			; 7
+_gate_pad:
+	DJNZ	_gate_pad		; 28 * 13 + 8
+	NOP				; 4
+	CALL	_gate_idle		; 17 + 58 + idle units
+	
+	; Counting loop - keep the common path fixed length
+_gate_loop:
+	LD	A, (GATE_SPIN)		; 13
+	LD	B, A			; 4
+	INC	B			; 4  B = spin + 1 (256 passes for 255)
+_gate_spin:
+	DJNZ	_gate_spin		; 13 per spin pass, 8 on exit
+	
+	CALL	_gate_call		; 17 + 20 dispatch
+	LD	A, H			; 4
+	OR	A			; 4
+	JR	NZ, _gate_poll_err	; 7
+	LD	C, L			; 4  Seconds
+	
+	LD	HL, (GATE_POLLS)	; 16
+	INC	HL			; 6
+	LD	(GATE_POLLS), HL	; 16
+	LD	A, H			; 4
+	OR	L			; 4
+	JR	Z, _gate_carry		; 7  Taken once per 65536 polls
+_gate_compare:
+	LD	A, C			; 4
+	LD	HL, GATE_LAST		; 10
+	CP	(HL)			; 7
+	JR	Z, _gate_loop		; 12 No edge yet
+	
+	; Edge found - fixed length up to the loop, 418 T-states over a
+	; no-edge poll (7 for the untaken JR Z above, 423 here, less 12)
+	; plus the idle units
+	LD	(HL), A			; 7
+	LD	HL, (GATE_POLLS)	; 16
+	LD	DE, (GATE_EDGE)		; 20 Count at the last edge
+	LD	(GATE_EDGE), HL		; 16
+	OR	A			; 4
+	SBC	HL, DE			; 15
+	EX	DE, HL			; 4  DE = this second's polls, low word
+	LD	HL, (GATE_POLLS+2)	; 16
+	LD	BC, (GATE_EDGE+2)	; 20
+	LD	(GATE_EDGE+2), HL	; 16 Stall check is relative to this edge
+	SBC	HL, BC			; 15 High word
+	LD	A, H			; 4
+	OR	L			; 4
+	SUB	1			; 7  Carry only if the high word is 0
+	SBC	A, A			; 4  FFh then, else 0
+	CPL				; 4  FFh if the count needs saturating
+	LD	B, A			; 4
+	OR	E			; 4
+	LD	E, A			; 4
+	LD	A, B			; 4
+	OR	D			; 4
+	LD	D, A			; 4
+	LD	HL, (GATE_MARKS)	; 16
+	LD	(HL), E			; 7  Record the second's polls
+	INC	HL			; 6
+	LD	(HL), D			; 7
+	DEC	HL			; 6
+	LD	BC, (GATE_STRIDE)	; 20
+	ADD	HL, BC			; 11
+	LD	(GATE_MARKS), HL	; 16
+	LD	HL, (GATE_EDGES)	; 16
+	DEC	HL			; 6
+	LD	(GATE_EDGES), HL	; 16
+	LD	A, H			; 4
+	OR	L			; 4
+	JR	Z, _gate_done		; 7
+	CALL	_gate_idle		; 17 + 58 + idle units
+	JP	_gate_loop		; 10
+	
+_gate_done:
+	; Done - store the count in the caller's structure
+	LD	HL, (GATE_PTR)
+	INC	HL
+	INC	HL
+	INC	HL
+	LD	DE, GATE_POLLS
+	EX	DE, HL
+	LD	BC, 4
+	LDIR
+	LD	HL, 0			; Return 0 (success)
+	JP	_gate_exit
+	
+_gate_carry:
+	; Low word wrapped - bump the high word and check for a stuck RTC
+	LD	HL, (GATE_POLLS+2)
+	INC	HL
+	LD	(GATE_POLLS+2), HL
+	LD	DE, (GATE_EDGE+2)
+	OR	A
+	SBC	HL, DE
+	LD	A, L
+	CP	4			; 262144 polls without an edge
+	JR	C, _gate_compare
+	JP	_gate_stall
+
+; Call the poll routine
+_gate_call:
+	LD	HL, (GATE_POLL_FN)	; 16
+	JP	(HL)			; 4
+
+; Idle for GATE_IDLE units: 58 T-states, then RTC_IDLE_TSTATES (3354)
+; per unit. Destroys AF, B, DE
+_gate_idle:
+	LD	DE, (GATE_IDLE)		; 20
+	INC	DE			; 6  The last pass only returns
+	LD	B, 0			; 7  DJNZ runs 256 passes
+_gate_idle_unit:
+	DEC	DE			; 6
+	LD	A, D			; 4
+	OR	E			; 4
+	RET	Z			; 5, 11 when done
+_gate_idle_wait:
+	DJNZ	_gate_idle_wait		; 255 * 13 + 8
+	JR	_gate_idle_unit		; 12
 
 ;
-; Set time to HBIOS RTC  
-; int hbios_rtc_set_time(const RTC_Time *time)
-; HL points to RTC_Time structure
-; Returns: 0 on success, -1 on error
+; Count passes over several HBIOS RTC units between their second edges
+; int rtc_gate_units(RTC_UnitGate *gate) __z88dk_fastcall
+; HL points to RTC_UnitGate: +0 seconds (word), +2 units (byte), then one
+; RTC_UNIT_SIZE record per unit: +0 unit, +1 last BCD second, +2 edges
+; left (word), +4 where the first mark goes (word), +6 first mark,
+; +12 last mark. A mark is the pass count (long) and the edges of all
+; units so far (word).
+; Returns: 0 on success, the poll's HBIOS error code, or 100h if a unit
+; stops ticking
 ;
-_hbios_rtc_set_time:
+; Every pass polls each unit once, in order. Each unit's first edge starts
+; its count and its marks; after gate->seconds more edges it is done, and
+; the gate ends when every unit is. A done unit is still polled, and its
+; last mark still follows its edges, so the pass length never changes.
+;
+; Timing (T-states): a pass is RTC_UNITS_PASS_TSTATES (111), plus per unit
+; RTC_UNITS_POLL_TSTATES (143) and the poll routine (as timed for rtc_gate,
+; whose LD of the unit this loop replaces), plus RTC_UNITS_EDGE_TSTATES
+; (615) for each edge seen. Between a unit's marks the time is
+;	passes * pass + edges * RTC_UNITS_EDGE_TSTATES
+; from the differences of the two marks, good to one pass.
+;
+_rtc_gate_units:
 	PUSH	BC
 	PUSH	DE
-	PUSH	HL			; Save structure pointer
 	
-	; Convert from our format (SSMMHHDDMMYY) to HBIOS format (YYMMDDHHMMSS)
-	; Our:   [0]=SS [1]=MM [2]=HH [3]=DD [4]=MM [5]=YY
-	; HBIOS: [0]=YY [1]=MM [2]=DD [3]=HH [4]=MM [5]=SS
-	
-	; Store year (our byte 5 -> HBIOS byte 0)
-	LD	A, (HL)			; Skip to year (byte 5)
+	LD	E, (HL)
 	INC	HL
+	LD	D, (HL)
 	INC	HL
+	INC	DE			; The first edge only starts the count
+	LD	A, (HL)
 	INC	HL
+	LD	(UNITS_COUNT), A
+	LD	(UNITS_LEFT), A		; Units not done
+	LD	(UNITS_FIRST), HL
+	LD	B, A
+	
+	; Read each unit's second (not counted), and clear its marks
+_units_init:
+	PUSH	BC
+	PUSH	DE
+	LD	(UNITS_REC), HL
+	LD	A, (HL)
+	CALL	_rtc_poll_unit
+	POP	DE
+	POP	BC
+	LD	A, H
+	OR	A
+	JP	NZ, _units_error
+	LD	A, L
+	LD	HL, (UNITS_REC)
 	INC	HL
+	LD	(HL), A			; Last second
 	INC	HL
-	LD	A, (HL)			; Get year
-	LD	(TIME_BUF_SET+0), A		; Store in HBIOS buffer
-	
-	; Restore pointer and get month (our byte 4 -> HBIOS byte 1)
-	POP	HL			; Restore structure pointer
-	PUSH	HL			; Save again
+	LD	(HL), E			; Edges left
 	INC	HL
+	LD	(HL), D
 	INC	HL
+	PUSH	DE
+	LD	D, H			; First mark goes to +6
+	LD	E, L
+	INC	DE
+	INC	DE
+	LD	(HL), E
 	INC	HL
-	INC	HL			; Point to month
-	LD	A, (HL)			; Get month
-	LD	(TIME_BUF_SET+1), A		; Store in HBIOS buffer
-	
-	; Get date (our byte 3 -> HBIOS byte 2)
-	DEC	HL			; Point to date
-	LD	A, (HL)			; Get date
-	LD	(TIME_BUF_SET+2), A		; Store in HBIOS buffer
+	LD	(HL), D
+	INC	HL
+	LD	C, B
+	LD	B, 12
+	XOR	A
+_units_clear:
+	LD	(HL), A
+	INC	HL
+	DJNZ	_units_clear
+	POP	DE
+	LD	B, C
+	DJNZ	_units_init
+	
+	LD	HL, 0
+	LD	(UNITS_PASSES), HL
+	LD	(UNITS_PASSES+2), HL
+	LD	(UNITS_EDGES), HL
+	
+	; Counting loop - keep every pass the same length
+_units_pass:
+	LD	HL, (UNITS_PASSES)	; 16
+	INC	HL			; 6
+	LD	(UNITS_PASSES), HL	; 16
+	LD	A, H			; 4
+	OR	L			; 4
+	JP	Z, _units_carry		; 10 Taken once per 65536 passes
+_units_start:
+	LD	HL, (UNITS_FIRST)	; 16
+	LD	A, (UNITS_COUNT)	; 13
+	LD	B, A			; 4
+_units_poll:
+	PUSH	BC			; 11
+	LD	(UNITS_REC), HL		; 16
+	LD	A, (HL)			; 7  Unit
+	CALL	_rtc_poll_unit		; 17, then the poll routine
+	LD	A, H			; 4
+	OR	A			; 4
+	JP	NZ, _units_poll_err	; 10
+	LD	A, L			; 4  Seconds
+	LD	HL, (UNITS_REC)		; 16
+	INC	HL			; 6
+	CP	(HL)			; 7
+	JP	NZ, _units_edge		; 10
+_units_next:
+	LD	DE, RTC_UNIT_SIZE - 1	; 10
+	ADD	HL, DE			; 11 Next record
+	POP	BC			; 10
+	DJNZ	_units_poll		; 13, 8 after the last unit
+	LD	A, (UNITS_LEFT)		; 13
+	OR	A			; 4
+	JP	NZ, _units_pass		; 10
 	
-	; Get hours (our byte 2 -> HBIOS byte 3)
-	DEC	HL			; Point to hours
-	LD	A, (HL)			; Get hours
-	LD	(TIME_BUF_SET+3), A		; Store in HBIOS buffer
+	LD	HL, 0			; Return 0 (success)
+	JP	_units_exit
+	
+_units_edge:
+	; Edge - fixed length back to _units_next, with HL as it left
+	LD	(HL), A			; 7  New second
+	LD	HL, (UNITS_EDGES)	; 16
+	INC	HL			; 6
+	LD	(UNITS_EDGES), HL	; 16
+	LD	HL, (UNITS_REC)		; 16
+	LD	DE, 12			; 10
+	ADD	HL, DE			; 11
+	EX	DE, HL			; 4  DE = last mark
+	LD	HL, UNITS_PASSES	; 10 Passes, then edges
+	LD	BC, 6			; 10
+	LDIR				; 121
+	LD	HL, (UNITS_REC)		; 16
+	LD	DE, 4			; 10
+	ADD	HL, DE			; 11
+	LD	E, (HL)			; 7
+	INC	HL			; 6
+	LD	D, (HL)			; 7  DE = where the first mark goes
+	LD	BC, UNITS_SCRATCH	; 10 Later edges copy it there
+	LD	(HL), B			; 7
+	DEC	HL			; 6
+	LD	(HL), C			; 7
+	LD	BC, 8			; 10
+	ADD	HL, BC			; 11 Last mark
+	LD	BC, 6			; 10
+	LDIR				; 121
+	LD	HL, (UNITS_REC)		; 16
+	INC	HL			; 6
+	INC	HL			; 6
+	LD	E, (HL)			; 7
+	INC	HL			; 6
+	LD	D, (HL)			; 7
+	DEC	DE			; 6
+	LD	(HL), D			; 7
+	DEC	HL			; 6
+	LD	(HL), E			; 7  Edges left
+	LD	A, D			; 4
+	OR	E			; 4
+	SUB	1			; 7  Carry only on reaching 0
+	SBC	A, A			; 4  FFh then, else 0
+	LD	HL, UNITS_LEFT		; 10
+	ADD	A, (HL)			; 7
+	LD	(HL), A			; 7  One unit fewer to go then
+	LD	HL, (UNITS_REC)		; 16
+	INC	HL			; 6
+	JP	_units_next		; 10
+	
+_units_carry:
+	; Low word wrapped - bump the high word, and stop if a unit has not
+	; ticked for 65536 passes or more (its last mark's high word is two
+	; or more back)
+	LD	HL, (UNITS_PASSES+2)
+	INC	HL
+	LD	(UNITS_PASSES+2), HL
+	LD	HL, (UNITS_FIRST)
+	LD	DE, 14			; High word of the last mark's passes
+	ADD	HL, DE
+	LD	A, (UNITS_COUNT)
+	LD	B, A
+_units_stall_check:
+	LD	E, (HL)
+	INC	HL
+	LD	D, (HL)
+	PUSH	HL
+	LD	HL, (UNITS_PASSES+2)
+	OR	A
+	SBC	HL, DE
+	LD	A, H
+	OR	A
+	JR	NZ, _units_stall
+	LD	A, L
+	CP	2
+	JR	NC, _units_stall
+	POP	HL
+	LD	DE, RTC_UNIT_SIZE - 1
+	ADD	HL, DE
+	DJNZ	_units_stall_check
+	JP	_units_start
+	
+_units_stall:
+	POP	HL
+	LD	HL, 100h		; Return 100h (RTC not ticking)
+	JR	_units_exit
+	
+_units_poll_err:
+	POP	BC
+_units_error:
+	LD	H, 0			; Return the error code from L
 	
-	; Get minutes (our byte 1 -> HBIOS byte 4)
-	DEC	HL			; Point to minutes
-	LD	A, (HL)			; Get minutes
-	LD	(TIME_BUF_SET+4), A		; Store in HBIOS buffer
+_units_exit:
+	POP	DE
+	POP	BC
+	RET
+
+;
+; Set time to HBIOS RTC
+; int hbios_rtc_set_time(const RTC_Time *time) __z88dk_fastcall
+; HL points to RTC_Time structure
+; Returns: 0 on success, -1 on error
+;
+; The fields are copied in reverse into a buffer on the stack:
+; Our:   [0]=SS [1]=MM [2]=HH [3]=DD [4]=MM [5]=YY
+; HBIOS: [0]=YY [1]=MM [2]=DD [3]=HH [4]=MM [5]=SS
+;
+_hbios_rtc_set_time:
+	PUSH	BC
+	PUSH	DE
 	
-	; Get seconds (our byte 0 -> HBIOS byte 5)
-	DEC	HL			; Point to seconds
-	LD	A, (HL)			; Get seconds
-	LD	(TIME_BUF_SET+5), A		; Store in HBIOS buffer
+	EX	DE, HL			; DE = structure
+	LD	HL, -6
+	ADD	HL, SP
+	LD	SP, HL			; HBIOS buffer on the stack
+	LD	BC, 5
+	ADD	HL, BC			; HL = HBIOS seconds
+	LD	B, 6
+_set_time_copy:
+	LD	A, (DE)
+	LD	(HL), A
+	INC	DE
+	DEC	HL
+	DJNZ	_set_time_copy
+	INC	HL			; HL = buffer
 	
 	; Call HBIOS to set time
-	LD	B, 21h			; HBIOS RTC set time function
-	LD	D, 0			; Unit 0
-	LD	HL, TIME_BUF_SET	; Point to HBIOS buffer
+	LD	B, BF_RTCSET		; HBIOS RTC set time function
+	LD	A, (_hbios_rtc_unit)	; Selected unit, in C and D
+	LD	C, A
+	LD	D, A
 	RST	08			; Call HBIOS via RST
 	
-	; Check result
-	OR	A			; Test A for zero
-	JR	NZ, _set_time_error	; Jump if error
-	
-	POP	HL			; Restore structure pointer
+	LD	HL, 6
+	ADD	HL, SP
+	LD	SP, HL			; Drop the buffer
 	LD	HL, 0			; Return 0 (success)
-	JR	_set_time_exit
-	
-_set_time_error:
-	POP	HL			; Restore structure pointer  
-	LD	HL, 0FFFFh		; Return -1 (error)
+	OR	A			; Test A for zero
+	JR	Z, _set_time_exit
+	DEC	HL			; Return -1 (error)
 	
 _set_time_exit:
 	POP	DE
@@ -186,33 +692,152 @@ _set_time_exit:
 	RET
 
 ;
-; Simple test function exactly like working example
+; Read the RTC and return the HBIOS status
 ; int hbios_rtc_test(void)
 ; Returns error code directly from HBIOS
 ;
 _hbios_rtc_test:
-	PUSH	DE			; Save DE register
-	
-	; Try with unit 0 first (most common)
-	LD	B, 20h			; RTC get time function
-	LD	D, 0			; Unit 0
-	LD	HL, TIME_BUF		; Point to buffer
-	RST	08			; Call HBIOS
-	
-	; Return error code in HL
+	PUSH	BC
+	PUSH	DE
+	CALL	_rtc_read_stack
 	LD	L, A			; Return HBIOS error code
 	LD	H, 0			; Clear high byte
-	
-	POP	DE			; Restore DE
+	POP	DE
+	POP	BC
+	RET
+
+;
+; BCD conversions
+;
+; The register routines work on A and destroy B and C only, so the field
+; loops below can keep the pointer in HL and the count in E.
+;
+
+; A = BCD byte, returns A = binary, or 0 if either digit is over 9
+_bcd_a:
+	LD	B, A
+	AND	0Fh			; Units digit
+	CP	10
+	JR	NC, _bcd_a_bad
+	LD	C, A
+	LD	A, B
+	CP	0A0h			; Tens digit over 9?
+	JR	NC, _bcd_a_bad
+	AND	0F0h			; Tens * 16
+	RRCA				; Tens * 8
+	LD	B, A
+	RRCA
+	RRCA				; Tens * 2
+	ADD	A, B			; Tens * 10
+	ADD	A, C			; Plus units
+	RET
+_bcd_a_bad:
+	XOR	A
+	RET
+
+; A = binary, returns A = BCD, clamped to 99
+; Doubles the BCD result with DAA once per source bit, high bit first.
+_bin_a:
+	CP	100
+	JR	C, _bin_a_ok
+	LD	A, 99
+_bin_a_ok:
+	LD	B, A			; Source bits
+	LD	C, 8
+	XOR	A			; BCD result
+_bin_a_loop:
+	SLA	B			; Next source bit into carry
+	ADC	A, A			; Result * 2 + bit
+	DAA
+	DEC	C
+	JR	NZ, _bin_a_loop
+	RET
+
+;
+; unsigned char rtc_bcd_to_bin(unsigned char bcd) __z88dk_fastcall
+; Returns: binary value, 0 for invalid BCD
+;
+_rtc_bcd_to_bin:
+	LD	A, L
+	CALL	_bcd_a
+	LD	L, A
+	LD	H, 0
+	RET
+
+;
+; unsigned char rtc_bin_to_bcd(unsigned char bin) __z88dk_fastcall
+; Returns: BCD value, clamped to 99
+;
+_rtc_bin_to_bcd:
+	LD	A, L
+	CALL	_bin_a
+	LD	L, A
+	LD	H, 0
+	RET
+
+;
+; unsigned char rtc_time_seconds(const RTC_Time *time) __z88dk_fastcall
+; Returns: the BCD seconds field as binary, leaving the structure alone
+;
+_rtc_time_seconds:
+	LD	A, (HL)			; Seconds is the first field
+	CALL	_bcd_a
+	LD	L, A
+	LD	H, 0
+	RET
+
+;
+; void rtc_time_from_bcd(RTC_Time *time) __z88dk_fastcall
+; void rtc_time_to_bcd(RTC_Time *time) __z88dk_fastcall
+; Convert all six fields in place. Destroys BC, DE
+;
+_rtc_time_from_bcd:
+	LD	E, 6
+_from_bcd_loop:
+	LD	A, (HL)
+	CALL	_bcd_a
+	LD	(HL), A
+	INC	HL
+	DEC	E
+	JR	NZ, _from_bcd_loop
+	RET
+
+_rtc_time_to_bcd:
+	LD	E, 6
+_to_bcd_loop:
+	LD	A, (HL)
+	CALL	_bin_a
+	LD	(HL), A
+	INC	HL
+	DEC	E
+	JR	NZ, _to_bcd_loop
 	RET
 
 	SECTION data_user
 
-; Separate buffers for each function to prevent corruption
-TIME_BUF_DETECT:	DS	6	; Buffer for detect function
-TIME_BUF_GET:		DS	6	; Buffer for get_time function  
-TIME_BUF_SET:		DS	6	; Buffer for set_time function
-TIME_BUF_TEST:		DS	6	; Buffer for test function
+; HBIOS RTC unit used by every entry point but hbios_rtc_read and
+; hbios_rtc_write, which take it from the buffer. RomWBW takes the unit in C;
+; it is also passed in D as this code always has.
+_hbios_rtc_unit:	DB	0
+
+; Gate counter state
+GATE_PTR:		DS	2	; Caller's RTC_Gate structure
+GATE_EDGES:		DS	2	; Edges still to count
+GATE_SPIN:		DS	1	; Spin passes per poll
+GATE_LAST:		DS	1	; Last BCD seconds value seen
+GATE_POLLS:		DS	4	; Poll count (32-bit)
+GATE_EDGE:		DS	4	; Count at the last edge
+GATE_POLL_FN:		DS	2	; Poll routine
+GATE_MARKS:		DS	2	; Where the next edge's count goes
+GATE_STRIDE:		DS	2	; 2, or 0 when not recording
+GATE_IDLE:		DS	2	; Idle units after each edge
+GATE_SCRATCH:		DS	2	; Unrecorded second counts
 
-; Legacy buffer name for compatibility
-TIME_BUF:		EQU	TIME_BUF_TEST
+; Unit gate state
+UNITS_COUNT:		DS	1	; Units polled each pass
+UNITS_LEFT:		DS	1	; Units not done
+UNITS_FIRST:		DS	2	; First unit record
+UNITS_REC:		DS	2	; Record of the unit being polled
+UNITS_PASSES:		DS	4	; Pass count (32-bit), then
+UNITS_EDGES:		DS	2	; edges of all units: a mark
+UNITS_SCRATCH:		DS	6	; First marks after the first edge
@@ -10,10 +10,120 @@ typedef struct {
     unsigned char year;
 } RTC_Time;
 
-// Function prototypes for HBIOS RTC access
+// Edge-to-edge poll counter for rtc_gate()
+typedef struct {
+    unsigned int seconds;   // RTC second edges to span
+    unsigned char spin;     // Extra delay passes per poll (0-255)
+    unsigned long polls;    // Result: polls between first and last edge
+    int (*poll)(void);      // Seconds reader, see RTC_Backend.poll
+    unsigned int *marks;    // If not 0, gets the polls of each second
+                            // (FFFFh if more)
+    unsigned int idle;      // RTC_IDLE_TSTATES units to wait after each edge
+} RTC_Gate;
+
+// T-states of one gate poll, excluding the poll routine itself
+#define RTC_POLL_TSTATES    171
+// Extra T-states of the poll that sees an edge
+#define RTC_EDGE_TSTATES    418
+// Extra T-states per poll added by gate->spin
+#define RTC_SPIN_TSTATES(n) (13 * (n))
+// T-states of n gate->idle units after an edge
+#define RTC_IDLE_TSTATES(n) (3354.0 * (n))
+// rtc_gate() result when the seconds value stops changing
+#define RTC_GATE_STALL      0x100
+
+// Units enumerated and calibrated at most
+#define RTC_MAX_UNITS 4
+
+// rtc_gate_units(): one gate over several HBIOS RTC units, polling each
+// unit in turn on every pass. A mark is taken at one of a unit's edges.
+typedef struct {
+    unsigned long passes;   // Passes so far
+    unsigned int edges;     // Edges of all units so far
+} RTC_UnitMark;
+
+typedef struct {
+    unsigned char unit;     // HBIOS RTC unit
+    unsigned char second;   // Internal: last BCD second
+    unsigned int left;      // Edges to go; seconds - left edges were spanned
+    RTC_UnitMark *next;     // Internal: where the first edge's mark goes
+    RTC_UnitMark first;     // Result: marks at the unit's first edge
+    RTC_UnitMark last;      //   and at its latest
+} RTC_UnitRecord;
+
+typedef struct {
+    unsigned int seconds;   // Edges of every unit to span
+    unsigned char units;    // Records in unit[], 1 to RTC_MAX_UNITS
+    RTC_UnitRecord unit[RTC_MAX_UNITS];
+} RTC_UnitGate;
+
+// T-states of a pass, and per unit in it, the poll timed for rtc_gate() with
+// RTC_POLL_TSTATES replaced by RTC_UNITS_POLL_TSTATES; an edge adds
+// RTC_UNITS_EDGE_TSTATES to its pass
+#define RTC_UNITS_PASS_TSTATES  111
+#define RTC_UNITS_POLL_TSTATES  143
+#define RTC_UNITS_EDGE_TSTATES  615
+
+// RTC backend: the entry points for one way of reaching the clock.
+// Times are BCD in RTC_Time order; get/set return 0 (or 0xB8) on success.
+typedef struct {
+    char *name;
+    int (*detect)(void);                    // 1 if the clock answers
+    int (*get_time)(RTC_Time *time);
+    int (*set_time)(const RTC_Time *time);
+    int (*poll)(void);                      // BCD seconds in the low byte,
+                                            // high byte non-zero on error
+} RTC_Backend;
+
+// Backend in use, chosen at startup
+extern RTC_Backend *rtc;
+extern RTC_Backend hbios_backend;
+extern RTC_Backend ds1302_backend;
+extern RTC_Backend ds3231_backend;
+
+// Run a gate against the current backend
+int rtcGate(RTC_Gate *gate);
+
+// HBIOS RTC unit used by the hbios_rtc_* entry points (default 0)
+extern unsigned char hbios_rtc_unit;
+
+// Function prototypes for HBIOS RTC access. The time is read into the
+// caller's structure or a buffer on the stack, never static storage, but
+// these take the unit from hbios_rtc_unit: a reader of another unit
+// should use hbios_rtc_read() and hbios_rtc_write() below instead.
 int hbios_rtc_detect(void);
-int hbios_rtc_get_time(RTC_Time *time);
-int hbios_rtc_set_time(const RTC_Time *time);
+int hbios_rtc_get_time(RTC_Time *time) __z88dk_fastcall;
+int hbios_rtc_set_time(const RTC_Time *time) __z88dk_fastcall;
 int hbios_rtc_test(void);
+// Seconds-only fast path: BCD seconds, or 0x100 | HBIOS error
+int hbios_rtc_poll(void);
+
+// Time in HBIOS order (BCD), read or written as it is with no copying,
+// and the unit it belongs to, so readers of different units do not share
+// hbios_rtc_unit. Both return the HBIOS status.
+typedef struct {
+    unsigned char year;
+    unsigned char month;
+    unsigned char date;
+    unsigned char hour;
+    unsigned char minute;
+    unsigned char second;
+    unsigned char unit;     // HBIOS RTC unit
+} RTC_HbiosTime;
+
+int hbios_rtc_read(RTC_HbiosTime *buf) __z88dk_fastcall;
+int hbios_rtc_write(const RTC_HbiosTime *buf) __z88dk_fastcall;
+
+// The gates keep their working state in static storage in rtc.asm, so
+// neither may be entered twice at once
+int rtc_gate(RTC_Gate *gate) __z88dk_fastcall;
+int rtc_gate_units(RTC_UnitGate *gate) __z88dk_fastcall;
+
+// BCD conversions (rtc.asm). Invalid BCD reads as 0, binary clamps to 99.
+unsigned char rtc_bcd_to_bin(unsigned char bcd) __z88dk_fastcall;
+unsigned char rtc_bin_to_bcd(unsigned char bin) __z88dk_fastcall;
+unsigned char rtc_time_seconds(const RTC_Time *time) __z88dk_fastcall;
+void rtc_time_from_bcd(RTC_Time *time) __z88dk_fastcall;
+void rtc_time_to_bcd(RTC_Time *time) __z88dk_fastcall;
 
 #endif // RTC_H
@@ -1,68 +1,26 @@
 #include "cpm.h"
 #include "rtc.h"
 #include "ansi.h"
+#include "console.h"
+#include "hbios.h"
+#include "stats.h"
+#include "calendar.h"
+#include "profile.h"
+#include "rtctrim.h"
+#include "logger.h"
+#include "ds3231.h"
+#include <math.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
 
 void printLong(unsigned long num);
+int parseTime(char *timeStr, unsigned char *hour, unsigned char *minute, unsigned char *second);
+void storeSetTime(RTC_Time *time);
 int ansi_enabled = 0;
 
-int cpm_putchar(int c) {
-    __asm
-        ld c, 2
-        ld e, l
-        call 5
-    __endasm;
-    return c;
-}
-
-// Convert BCD to decimal
-unsigned char bcdToDecimal(unsigned char bcd) { 
-    unsigned char hi = (bcd & 0xF0) >> 4;
-    unsigned char lo = bcd & 0x0F;
-    if (hi > 9 || lo > 9) return 0; // Invalid BCD
-    return hi * 10 + lo;
-}
-
-// Convert decimal to BCD
-unsigned char decimalToBcd(unsigned char decimal) {
-    if (decimal > 99) decimal = 99; // Clamp to valid range
-    unsigned char hi = decimal / 10;
-    unsigned char lo = decimal % 10;
-    return (hi << 4) | lo;
-}
-
-// Convert datetime from BCD to decimal
-void convertFromBcd(RTC_Time *datetime) {
-    datetime->second = bcdToDecimal(datetime->second);
-    datetime->minute = bcdToDecimal(datetime->minute);
-    datetime->hour   = bcdToDecimal(datetime->hour);
-    datetime->date   = bcdToDecimal(datetime->date);
-    datetime->month  = bcdToDecimal(datetime->month);
-    datetime->year   = bcdToDecimal(datetime->year);
-}
-
-// Convert datetime from decimal to BCD
-void convertToBcd(RTC_Time *datetime) {
-    datetime->second = decimalToBcd(datetime->second);
-    datetime->minute = decimalToBcd(datetime->minute);
-    datetime->hour   = decimalToBcd(datetime->hour);
-    datetime->date   = decimalToBcd(datetime->date);
-    datetime->month  = decimalToBcd(datetime->month);
-    datetime->year   = decimalToBcd(datetime->year);
-}
-
 RTC_Time datetime;
 
-// Simple print functions without stdio
-void printStr(char *str) {
-    while (*str) {
-        cpm_putchar(*str++);
-    }
-}
-
-void printChar(char ch) {
-    cpm_putchar(ch);
-}
-
 void printNum(unsigned char num) {
     if (num >= 10) {
         printChar('0' + (num / 10));
@@ -100,7 +58,7 @@ int readString(char *buffer, int maxLen) {
     char ch;
     
     while (pos < maxLen - 1) {
-        ch = cRawIo();
+        ch = readKey();
         if (ch == 0) continue;  // No key pressed
         
         if (ch == 27) {  // ESC key
@@ -133,85 +91,19 @@ int readString(char *buffer, int maxLen) {
     return 0;
 }
 
-// Add minutes to time
+// Add minutes to time, carrying into the date
 void adjustTimeMinutes(RTC_Time *time, int minutes) {
-    int total_minutes = time->minute + minutes;
-    int total_hours = time->hour;
-    
-    // Handle minutes overflow/underflow
-    while (total_minutes >= 60) {
-        total_minutes -= 60;
-        total_hours++;
-    }
-    while (total_minutes < 0) {
-        total_minutes += 60;
-        total_hours--;
-    }
-    
-    // Handle hours overflow/underflow
-    while (total_hours >= 24) {
-        total_hours -= 24;
-    }
-    while (total_hours < 0) {
-        total_hours += 24;
-    }
-    
-    // Update time
-    time->minute = total_minutes;
-    time->hour = total_hours;
+    calAddSeconds(time, minutes * 60L);
 }
 
-// Add seconds and round to next 10-second mark
+// Add seconds and round to the next 10-second mark in that direction
 void adjustTimeRounded(RTC_Time *time, int seconds) {
-    int total_seconds = time->second + seconds;
-    int total_minutes = time->minute;
-    int total_hours = time->hour;
-    
-    // Handle seconds overflow/underflow
-    while (total_seconds >= 60) {
-        total_seconds -= 60;
-        total_minutes++;
-    }
-    while (total_seconds < 0) {
-        total_seconds += 60;
-        total_minutes--;
-    }
-    
-    // Round to next 10-second mark
+    calAddSeconds(time, seconds);
     if (seconds > 0) {
-        // Round up to next decade
-        total_seconds = ((total_seconds + 9) / 10) * 10;
-        if (total_seconds >= 60) {
-            total_seconds = 0;
-            total_minutes++;
-        }
+        calAddSeconds(time, (10 - time->second % 10) % 10);
     } else if (seconds < 0) {
-        // Round down to previous decade
-        total_seconds = (total_seconds / 10) * 10;
-    }
-    
-    // Handle minutes overflow/underflow
-    while (total_minutes >= 60) {
-        total_minutes -= 60;
-        total_hours++;
-    }
-    while (total_minutes < 0) {
-        total_minutes += 60;
-        total_hours--;
-    }
-    
-    // Handle hours overflow/underflow
-    while (total_hours >= 24) {
-        total_hours -= 24;
+        calAddSeconds(time, -(long)(time->second % 10));
     }
-    while (total_hours < 0) {
-        total_hours += 24;
-    }
-    
-    // Update only the time portion
-    time->second = total_seconds;
-    time->minute = total_minutes;
-    time->hour = total_hours;
 }
 
 // Print only time portion (HH:MM:SS)
@@ -240,7 +132,7 @@ int interactiveTimeSet(RTC_Time *time) {
         printStr("     ");
         
         // Wait for key input
-        ch = cRawIo();
+        ch = readKey();
         if (ch == 0) continue;
         
         if (escape_seq == 0 && ch == 27) {  // ESC or start of arrow sequence
@@ -281,7 +173,7 @@ int interactiveTimeSet(RTC_Time *time) {
                 
                 // Read rest of time string
                 while (pos < 8) {
-                    char input = cRawIo();
+                    char input = readKey();
                     if (input == 0) continue;
                     
                     if (input == 27) {  // ESC - cancel manual entry
@@ -359,10 +251,8 @@ int parseDate(char *dateStr, unsigned char *day, unsigned char *month, unsigned
     y = (dateStr[6] - '0') * 1000 + (dateStr[7] - '0') * 100 + 
         (dateStr[8] - '0') * 10 + (dateStr[9] - '0');
     
-    // Basic validation
-    if (d < 1 || d > 31) return 0;
-    if (m < 1 || m > 12) return 0;
     if (y < 2000 || y > 2099) return 0;  // We only support 20xx years
+    if (!calValidDate(d, m, y - 2000)) return 0;
     
     *day = d;
     *month = m;
@@ -409,9 +299,9 @@ void setDate(void) {
     printStr("\r\n=== Set RTC Date ===\r\n");
     
     // Get current RTC time to preserve time and use current date as default
-    int rtc_result = hbios_rtc_get_time(&current_time);
+    int rtc_result = rtc->get_time(&current_time);
     if (rtc_result == 0 || rtc_result == 0xB8) {
-        convertFromBcd(&current_time);
+        rtc_time_from_bcd(&current_time);
         printStr("Current date: ");
         printNum2(current_time.date);
         printChar('/');
@@ -446,7 +336,7 @@ void setDate(void) {
         year = current_time.year;
     } else {
         if (!parseDate(dateBuffer, &day, &month, &year)) {
-            printStr("Invalid date format. Use dd/mm/yyyy\r\n");
+            printStr("Invalid date. Use dd/mm/yyyy\r\n");
             return;
         }
     }
@@ -466,11 +356,12 @@ void setDate(void) {
     }
     
     // Convert to BCD and set the RTC
-    convertToBcd(&datetime);
-    if (hbios_rtc_set_time(&datetime) == 0) {
+    rtc_time_to_bcd(&datetime);
+    if (rtc->set_time(&datetime) == 0) {
+        storeSetTime(&datetime);
         printStr("\r\nDate set successfully to: ");
         // Convert back to decimal for display
-        convertFromBcd(&datetime);
+        rtc_time_from_bcd(&datetime);
         printNum2(datetime.date);
         printChar('/');
         printNum2(datetime.month);
@@ -489,13 +380,15 @@ void setTime(void) {
     printStr("\r\n=== Set RTC Time ===\r\n");
     
     // Get current RTC time to use as starting point
-    int rtc_result = hbios_rtc_get_time(&current_time);
+    int rtc_result = rtc->get_time(&current_time);
     if (rtc_result == 0 || rtc_result == 0xB8) {
-        convertFromBcd(&current_time);
+        rtc_time_from_bcd(&current_time);
         printStr("Current time: ");
         printDateTime(&current_time);
         printStr("\r\n");
-    } else {
+    }
+    // The arrow keys need a real date to carry into
+    if ((rtc_result != 0 && rtc_result != 0xB8) || !calValidTime(&current_time)) {
         printStr("Cannot read current time, using defaults\r\n");
         current_time.hour = 12;
         current_time.minute = 0;
@@ -513,12 +406,13 @@ void setTime(void) {
     
     // Set the RTC with the adjusted time
     datetime = current_time;  // Copy the adjusted time
-    convertToBcd(&datetime);
+    rtc_time_to_bcd(&datetime);
     
-    if (hbios_rtc_set_time(&datetime) == 0) {
+    if (rtc->set_time(&datetime) == 0) {
+        storeSetTime(&datetime);
         printStr("\r\nTime set successfully to: ");
         // Convert back to decimal for display
-        convertFromBcd(&datetime);
+        rtc_time_from_bcd(&datetime);
         printDateTime(&datetime);
         printStr("\r\n");
     } else {
@@ -549,308 +443,1921 @@ void printLong(unsigned long num) {
 }
 
 
-// Print percentage with 2 decimal places (multiplied by 100)
-void printPercentage(long pct_100) {
-    if (pct_100 < 0) {
+// Print a signed value with a fixed number of decimal places (0-4)
+void printFixed(double value, unsigned char decimals) {
+    unsigned long scale = 1;
+    unsigned long scaled, whole, frac;
+    unsigned char i;
+
+    for (i = 0; i < decimals; i++) scale *= 10;
+
+    if (value < 0) {
         printChar('-');
-        pct_100 = -pct_100;
+        value = -value;
     }
-    
-    unsigned long whole = pct_100 / 100;
-    unsigned long frac = pct_100 % 100;
-    
+
+    scaled = (unsigned long)(value * scale + 0.5);
+    whole = scaled / scale;
+    frac = scaled % scale;
+
     printLong(whole);
+    if (decimals == 0) return;
     printChar('.');
-    if (frac < 10) printChar('0');
+    // Leading zeros of the fractional part
+    for (scale /= 10; scale > 1 && frac < scale; scale /= 10) {
+        printChar('0');
+    }
     printLong(frac);
-    printChar('%');
 }
 
-// Simple RTC timing measurement - avoid crashes by using minimal RTC calls
-long measureRtcTiming(void) {
-    RTC_Time start_time, current_time;
-    unsigned long loop_count = 0;
-    unsigned char start_second, current_second;
-    int rtc_result;
+// Gate lengths offered by the calibration menu, in RTC seconds
+unsigned int gate_lengths[] = {1, 10, 60, 600};
+#define GATE_COUNT 4
+
+// CPU clock the RTC is compared against, and where the figure came from.
+// A build for one board can fix it with make CPU_HZ=n; HBIOS is then not
+// asked at startup, but /HZ= and K still override it.
+#ifdef CPU_HZ
+unsigned long cpu_clock_hz = CPU_HZ;
+char *cpu_clock_source = "build";
+#else
+unsigned long cpu_clock_hz = 7372800UL;
+char *cpu_clock_source = "default";
+#endif
+
+// Common RC2014 oscillators. HBIOS reports whole kHz, which is up to
+// 135 ppm short of the crystal, so a reading within 0.5% of one of these
+// is taken to be that crystal.
+unsigned long known_clocks[] = {
+    3686400UL, 4000000UL, 6000000UL, 7372800UL, 8000000UL, 9830400UL,
+    10000000UL, 12000000UL, 14745600UL, 16000000UL, 18432000UL,
+    20000000UL, 22118400UL, 24000000UL
+};
+#define KNOWN_CLOCK_COUNT 14
+
+// Set cpu_clock_hz from HBIOS SYSGET CPUINFO
+// Returns 1 on success, 0 if HBIOS did not report a speed
+int detectCpuClock(void) {
+    unsigned int khz = hbios_cpu_khz();
+    unsigned long hz, diff;
+    unsigned char i;
+    
+    if (khz == 0) return 0;
+    
+    hz = (unsigned long)khz * 1000;
+    for (i = 0; i < KNOWN_CLOCK_COUNT; i++) {
+        diff = known_clocks[i] > hz ? known_clocks[i] - hz : hz - known_clocks[i];
+        if (diff <= known_clocks[i] / 200) {
+            hz = known_clocks[i];
+            break;
+        }
+    }
+    
+    cpu_clock_hz = hz;
+    cpu_clock_source = "HBIOS";
+    return 1;
+}
+
+// Parse an unsigned decimal number, allowing ',' digit separators
+// Returns 1 on success, 0 on error
+int parseULong(char *str, unsigned long *value) {
+    unsigned long v = 0;
+    int digits = 0;
+    
+    for (; *str; str++) {
+        if (*str == ',') continue;
+        if (*str < '0' || *str > '9') return 0;
+        v = v * 10 + (*str - '0');
+        digits++;
+    }
+    
+    if (digits == 0 || digits > 9) return 0;
+    *value = v;
+    return 1;
+}
+
+// Returns 1 if str begins with prefix
+int startsWith(char *str, char *prefix) {
+    while (*prefix) {
+        if (*str++ != *prefix++) return 0;
+    }
+    return 1;
+}
+
+// Lowest and highest believable CPU clock for an override
+#define MIN_CLOCK_HZ 1000000UL
+#define MAX_CLOCK_HZ 60000000UL
+
+// Override the CPU clock for boards with a non-standard oscillator
+// Returns 1 on success, 0 if the value is out of range
+int overrideCpuClock(unsigned long hz) {
+    if (hz < MIN_CLOCK_HZ || hz > MAX_CLOCK_HZ) return 0;
+    cpu_clock_hz = hz;
+    cpu_clock_source = "override";
+    return 1;
+}
+
+// Print the CPU clock and its source
+void printCpuClock(void) {
+    printStr("CPU Clock: ");
+    printLong(cpu_clock_hz);
+    printStr(" Hz (");
+    printStr(cpu_clock_source);
+    printStr(")\r\n");
+}
+
+// HBIOS RTC units found at startup
+unsigned char rtc_units = 1;
+
+// Count the HBIOS RTC units. Older ROMs do not report a count; they have
+// one RTC at unit 0.
+void enumerateRtcUnits(void) {
+    rtc_units = hbios_rtc_count();
+    if (rtc_units == 0) rtc_units = 1;
+    if (rtc_units > RTC_MAX_UNITS) rtc_units = RTC_MAX_UNITS;
+}
+
+// Print "RTC unit n" for the HBIOS backend, or the I2C chip found
+void printRtcUnit(void) {
+    signed char aging;
+    
+    if (rtc == &ds3231_backend) {
+        if (ds3231_get_aging(&aging) == 0) {
+            printStr("DS3231, aging offset ");
+            printFixed(aging, 0);
+            printStr("\r\n");
+        } else if (ds3231_model == DS_MODEL_DS1307) {
+            printStr("DS1307 (no digital trim)\r\n");
+        }
+    }
+    if (rtc != &hbios_backend) return;
+    printStr("RTC unit ");
+    printNum(hbios_rtc_unit);
+    printStr(" of ");
+    printNum(rtc_units);
+    printStr("\r\n");
+}
+
+// Set the CPU clock from the menu
+void setCpuClock(void) {
+    char buffer[16];
+    unsigned long hz;
+    
+    printStr("\r\n=== CPU Clock ===\r\n");
+    printCpuClock();
+    printStr("New clock in Hz, 0 = ask HBIOS [keep]: ");
+    
+    if (readString(buffer, sizeof(buffer))) {
+        printStr("Aborted\r\n");
+        return;
+    }
+    if (buffer[0] == '\0') return;
     
-    // Get initial RTC time
-    rtc_result = hbios_rtc_get_time(&start_time);
-    if (rtc_result != 0 && rtc_result != 0xB8) {
-        return 0x8000;  // Error code
+    if (!parseULong(buffer, &hz)) {
+        printStr("Invalid number\r\n");
+        return;
     }
-    convertFromBcd(&start_time);
-    start_second = start_time.second;
     
-    // Wait for second to change to get clean boundary
-    do {
-        rtc_result = hbios_rtc_get_time(&current_time);
-        if (rtc_result != 0 && rtc_result != 0xB8) {
-            return 0x8000;  // Error code
+    if (hz == 0) {
+        if (!detectCpuClock()) {
+            printStr("HBIOS did not report a CPU speed\r\n");
         }
-        convertFromBcd(&current_time);
-        current_second = current_time.second;
-    } while (current_second == start_second);
-    
-    // Now count loops for exactly one second
-    start_second = current_second;
-    do {
-        loop_count++;
-        
-        // Limit loop count to 25,000 to prevent system slowdown with high capacitance
-        if (loop_count >= 25000) {
-            break;
+    } else if (!overrideCpuClock(hz)) {
+        printStr("Clock must be between 1,000,000 and 60,000,000 Hz\r\n");
+        return;
+    }
+    printCpuClock();
+}
+
+// Spin passes for the second gate of the poll cost timing
+#define CALIB_SPIN 255
+// RTC seconds of each of the two poll cost gates
+#define POLL_COST_SECS 30
+
+// Poll cost of a gate source: T-states per unspun poll, poll routine
+// included. It is timed once per run with two long gates, without and
+// with the spin delay, and then kept, so a reading needs only one unspun
+// gate and is good to about one poll instead of the two-gate difference's
+// six. It is never carried over from an earlier run: a reading scales
+// with it, so a cost gone stale after a ROM or clock change would bias
+// every reading by its own relative error.
+typedef struct {
+    int (*poll)(void);      // Source timed, 0 = none yet
+    unsigned char unit;     // HBIOS RTC unit it holds for
+    double tstates;
+    double error;           // +/- T-states, worst case
+} PollCost;
+
+PollCost rtc_cost;          // The current RTC's poll, timed once per run
+PollCost timer_cost;        // hbios_timer_poll, timed once per run
+
+// Error bar of the last measurement
+double resolution_ppm;   // +/- 1 poll and the poll cost error, worst case
+
+// Time a poll routine's cost over two gates of 'edges' changes of its
+// value (RTC seconds, timer ticks). Both gates span the same time, so
+//   n0 * c = n1 * (c + k)   ->   c = n1 * k / (n0 - n1)
+// with only the exact spin T-states k known. Returns 1 on success.
+int timePollCost(PollCost *cost, int (*poll)(void), unsigned int edges) {
+    RTC_Gate gate;
+    double n0, n1, k;
+    
+    conFlush();  // Nothing may reach the console during the gates
+    cost->poll = 0;
+    gate.seconds = edges;
+    gate.poll = poll;
+    gate.marks = 0;
+    gate.idle = 0;
+    gate.spin = 0;
+    if (rtc_gate(&gate) != 0) return 0;
+    n0 = gate.polls;
+    
+    gate.spin = CALIB_SPIN;
+    if (rtc_gate(&gate) != 0) return 0;
+    n1 = gate.polls;
+    if (n1 >= n0) return 0;  // Spin had no effect - source stepped oddly
+    
+    k = RTC_SPIN_TSTATES(CALIB_SPIN);
+    cost->tstates = n1 * k / (n0 - n1);
+    cost->error = k * (n0 + n1) / ((n0 - n1) * (n0 - n1));
+    cost->poll = poll;
+    cost->unit = hbios_rtc_unit;
+    return 1;
+}
+
+// Time the current RTC's poll cost afresh. Returns 1 on success.
+int retimeRtcCost(void) {
+    printStr("Timing the RTC read cost (two ");
+    printLong(POLL_COST_SECS);
+    printStr(" s gates)...\r\n");
+    return timePollCost(&rtc_cost, rtc->poll, POLL_COST_SECS);
+}
+
+// The current RTC's poll cost: timed earlier in this run, or now.
+// Returns 0 if it cannot be timed.
+PollCost *rtcPollCost(void) {
+    if (rtc_cost.poll == rtc->poll && rtc_cost.unit == hbios_rtc_unit) return &rtc_cost;
+    return retimeRtcCost() ? &rtc_cost : 0;
+}
+
+// T-states per edge from a single gate run with a known poll cost:
+//   T = (polls * c + idle) / edges + e
+// e is the edge path (RTC_EDGE_TSTATES). The edge is seen up to one poll
+// late at each end, so the reading is good to one poll plus the count
+// times the poll cost's error, which sets resolution_ppm.
+double gateHz(RTC_Gate *gate, PollCost *cost) {
+    double hz;
+    
+    hz = gate->polls * cost->tstates / gate->seconds + RTC_EDGE_TSTATES +
+         RTC_IDLE_TSTATES(gate->idle);
+    resolution_ppm = 1000000.0 * (cost->tstates + gate->polls * cost->error) /
+                     (gate->seconds * hz);
+    return hz;
+}
+
+// Measure CPU T-states between changes of a poll routine's value over a
+// gate of 'edges' changes, timing the poll cost first if it is not known.
+// Returns 0 on error.
+double measureEdges(PollCost *cost, int (*poll)(void), unsigned int edges, unsigned int cost_edges) {
+    RTC_Gate gate;
+    
+    if (cost->poll != poll && !timePollCost(cost, poll, cost_edges)) return 0;
+    conFlush();  // Nothing may reach the console during the gate
+    gate.seconds = edges;
+    gate.spin = 0;
+    gate.poll = poll;
+    gate.marks = 0;
+    gate.idle = 0;
+    if (rtc_gate(&gate) != 0) return 0;
+    return gateHz(&gate, cost);
+}
+
+unsigned int selectGate(void) {
+    char key;
+    unsigned char i;
+    
+    printStr("Gate length: ");
+    for (i = 0; i < GATE_COUNT; i++) {
+        printChar('1' + i);
+        printStr(") ");
+        printLong(gate_lengths[i]);
+        printStr(" s  ");
+    }
+    printStr("[1]: ");
+    
+    while (1) {
+        key = readKey();
+        if (key == 0) continue;
+        if (key == 27) return 0;
+        if (key == 13 || key == 10) key = '1';
+        if (key >= '1' && key < '1' + GATE_COUNT) {
+            printChar(key);
+            printStr("\r\n");
+            return gate_lengths[key - '1'];
         }
-        
-        // Check RTC every 5000 loops to avoid too many HBIOS calls but stay responsive
-        if ((loop_count % 5000) == 0) {
-            rtc_result = hbios_rtc_get_time(&current_time);
-            if (rtc_result != 0 && rtc_result != 0xB8) {
-                return 0x8000;  // Error code
-            }
-            convertFromBcd(&current_time);
-            current_second = current_time.second;
+    }
+}
+
+// Print a signed ppm figure with one decimal
+void printPpm(double ppm) {
+    if (ppm > 0) printChar('+');
+    printFixed(ppm, 1);
+}
+
+// Print running statistics of the ppm readings
+void printStats(RunningStats *stats) {
+    unsigned char level;
+    double adev;
+    
+    printStr("  n=");
+    printLong(stats->n);
+    printStr(" mean ");
+    printPpm(stats->mean);
+    printStr(" sd ");
+    printFixed(statsStdDev(stats), 1);
+    printStr(" min ");
+    printPpm(stats->min);
+    printStr(" max ");
+    printPpm(stats->max);
+    printStr(" med ");
+    printPpm(statsMedian(stats));
+    
+    // Allan deviation falling with tau means averaging longer helps;
+    // flat or rising means the oscillator itself is wandering
+    printStr("\r\n  ADEV");
+    for (level = 0; level < STATS_ALLAN_LEVELS; level++) {
+        adev = statsAllan(stats, level);
+        if (adev < 0) break;
+        printStr(" x");
+        printLong(1 << level);
+        printChar(' ');
+        printFixed(adev, 2);
+    }
+    if (level == 0) printStr(" (needs 2 readings)");
+    printStr(" ppm\r\n");
+}
+
+// Print a BCD time from RTCCAL.DAT, or "unknown" if it was never stored
+void printStoredTime(RTC_Time *time) {
+    RTC_Time shown = *time;
+    
+    rtc_time_from_bcd(&shown);
+    if (calValidTime(&shown)) {
+        printDateTime(&shown);
+    } else {
+        printStr("unknown");
+    }
+}
+
+// Show the current RTC's stored calibration from RTCCAL.DAT
+void printProfile(void) {
+    RTC_Profile *profile = profileLoad();
+    
+    if (!profile) {
+        printStr("No stored calibration for this RTC\r\n");
+        return;
+    }
+    if (profile->samples != 0) {
+        printStr("Last calibration: ");
+        printPpm(profile->ppm_milli / 1000.0);
+        printStr(" ppm +/- ");
+        printFixed(profile->error_milli / 1000.0, 1);
+        printStr(" (n=");
+        printLong(profile->samples);
+        if (profile->cpu_hz != cpu_clock_hz) {
+            printStr(" at ");
+            printLong(profile->cpu_hz);
+            printStr(" Hz");
+        }
+        printStr("), ");
+        printStoredTime(&profile->calibrated);
+        printStr("\r\n");
+    }
+    printStr("RTC last set: ");
+    printStoredTime(&profile->set);
+    printStr("\r\n");
+}
+
+// Error of the mean of n readings: their scatter over root n, but never
+// less than one reading's resolution. The resolution is the count's
+// quantisation and the read cost's error, which repeat in every reading
+// rather than averaging out, so it is a floor and is not divided by n.
+double calibrationError(RunningStats *stats, double resolution) {
+    double error = statsStdDev(stats) / sqrt(stats->n);
+    
+    return error < resolution ? resolution : error;
+}
+
+// Store a calibration of the current RTC in RTCCAL.DAT, with the error
+// from calibrationError()
+void storeCalibration(RunningStats *stats, double resolution) {
+    RTC_Profile *profile;
+    double error;
+    int status;
+    
+    if (stats->n == 0) return;
+    error = calibrationError(stats, resolution);
+    
+    profile = profileEdit();
+    profile->samples = stats->n;
+    profile->ppm_milli = (long)floor(stats->mean * 1000.0 + 0.5);
+    profile->error_milli = (unsigned long)(error * 1000.0 + 0.5);
+    profile->cpu_hz = cpu_clock_hz;
+    status = rtc->get_time(&profile->calibrated);
+    if (status != 0 && status != 0xB8) {
+        memset(&profile->calibrated, 0, sizeof(RTC_Time));
+    }
+    printStr(profileSave() ? "Saved to " PROFILE_FILE_NAME "." PROFILE_FILE_EXT "\r\n"
+                           : "Error writing " PROFILE_FILE_NAME "." PROFILE_FILE_EXT "\r\n");
+}
+
+// Note in RTCCAL.DAT when the RTC was set (time in BCD). A write error
+// is not worth interrupting the set for.
+void storeSetTime(RTC_Time *time) {
+    RTC_Profile *profile = profileEdit();
+    
+    profile->set = *time;
+    profileSave();
+}
+
+// Set the drift trim RSX (rtctrim.asm) from RTCCAL.DAT, or stop it.
+// The stored ppm is rescaled if the CPU clock has been changed since:
+// the RTC rate in T-states is what was measured.
+// A step of one second is due every 10^6 / |ppm| seconds, counted in
+// HBIOS timer ticks. Returns 1 on success.
+int setTrim(int on) {
+    TRIM_Config config;
+    CPM_RSXPB pb;
+    RTC_Profile *profile;
+    HBIOS_Timer timer;
+    double ppm, interval;
+    
+    memset(&config, 0, sizeof(config));
+    config.set = 1;
+    if (on) {
+        if (rtc != &hbios_backend) {
+            printStr("The trim RSX steps HBIOS RTCs only\r\n");
+            return 0;
+        }
+        profile = profileLoad();
+        if (!profile || profile->samples == 0) {
+            printStr("No stored calibration for this RTC - run C first\r\n");
+            return 0;
+        }
+        if (hbios_timer(&timer) != 0 || timer.rate == 0) {
+            printStr("HBIOS timer not available\r\n");
+            return 0;
+        }
+        ppm = ((double)cpu_clock_hz / profile->cpu_hz * (1.0 + profile->ppm_milli / 1000000000.0) - 1.0) * 1000000.0;
+        interval = timer.rate * 1000000.0 / fabs(ppm);
+        // Half the counter's range, so the RSX's wrap-safe compare holds
+        if (interval < 2147483647.0) {
+            config.step = ppm > 0 ? TRIM_STEP_DOWN : TRIM_STEP_UP;
+            config.unit = hbios_rtc_unit;
+            config.interval = (unsigned long)(interval + 0.5);
+        }
+    }
+    
+    pb.func = TRIM_FUNC;
+    pb.params = 1;
+    pb.param = &config;
+    if (cpm_call_rsx(&pb) != 0 || !config.loaded) {
+        printStr("RTCTRIM RSX not loaded (CP/M 3: GENCOM RTCCALIB RTCTRIM)\r\n");
+        return 0;
+    }
+    
+    if (config.step == 0) {
+        printStr("Drift trim off\r\n");
+    } else {
+        printStr("Drift trim: one second ");
+        printStr(config.step == TRIM_STEP_UP ? "on" : "back");
+        printStr(" every ");
+        printFixed(config.interval / (timer.rate * 3600.0), 1);
+        printStr(" h\r\n");
+    }
+    printLong(config.taken);
+    printStr(" step(s) taken since loading\r\n");
+    return 1;
+}
+
+// Readings of C, R and O record the polls of every second (16 bits each,
+// 1.2 KB at the longest gate). With the poll cost known, every second on
+// its own is also a one-second sample: T = idle + count * c + e. A gate
+// starts on the first edge after the call, so one second is lost before
+// each gate; C chains its readings (see measureContinuous()) so that this
+// happens between chains, not between readings.
+#define CONT_MAX_SECONDS 600
+unsigned int cont_marks[CONT_MAX_SECONDS];
+unsigned long cont_polls; // Polls of the whole last gate
+double cont_poll;        // Poll cost of the last gate, for the log
+double cont_poll_error;  // +/- of the poll cost
+double cont_idle;        // T-states idled after each edge of it
+
+// Readings chained into one gate by measureContinuous(), at most
+#define CONT_CHAIN_SECONDS 60
+
+unsigned int cont_chain;     // Readings in the last chained gate
+unsigned int cont_next;      // Next of them to hand out
+unsigned int *cont_reading;  // Marks of the reading handed out last
+
+// One gate polling throughout. Returns T-states per RTC second, 0 on error.
+double measureFull(unsigned int gate_secs, PollCost *cost) {
+    RTC_Gate gate;
+    
+    if (gate_secs > CONT_MAX_SECONDS) return 0;
+    conFlush();  // Nothing may reach the console during the gate
+    gate.seconds = gate_secs;
+    gate.spin = 0;
+    gate.poll = rtc->poll;
+    gate.marks = cont_marks;
+    gate.idle = 0;
+    if (rtc_gate(&gate) != 0) return 0;
+    cont_polls = gate.polls;
+    cont_poll = cost->tstates;
+    cont_poll_error = cost->error;
+    cont_idle = 0;
+    return gateHz(&gate, cost);
+}
+
+// Per-second sample log for /LOG=file: the counts behind every reading of
+// C, for fitting elsewhere. A .CSV name gives lines of
+// reading,second,poll_tstates,idle_tstates,polls; any other name the
+// binary form, a SampleHeader record and then for each reading
+// SAMPLE_READING, the gate length G, the poll cost in 1/1000 T-states
+// (32 bits), the idle T-states after each edge (32 bits) and G 16-bit
+// counts. Each second is idle + count * poll cost + edge T-states.
+// The log is buffered in RAM and flushed right after each gate, which
+// ends on an edge, so the writes fall in the next gate's wait for its
+// first edge and no measured second is touched.
+#define SAMPLE_MAGIC   "RTCSAMP"
+#define SAMPLE_VERSION 3
+#define SAMPLE_READING 0xFFFF
+
+// Fixed-width fields, as for DriftHeader, so host and target logs match
+#define SAMPLE_HEADER_USED 18
+
+typedef struct {
+    char magic[8];
+    uint8_t version;
+    char backend;            // First letter of the RTC backend name
+    uint8_t unit;            // HBIOS RTC unit
+    uint8_t reserved;
+    uint32_t cpu_hz;         // Clock the counts were taken against
+    uint16_t edge;           // RTC_EDGE_TSTATES
+    uint8_t pad[CPM_RECORD - SAMPLE_HEADER_USED];
+} SampleHeader;
+
+typedef char sample_header_used[offsetof(SampleHeader, pad) == SAMPLE_HEADER_USED ? 1 : -1];
+typedef char sample_header_size[sizeof(SampleHeader) == CPM_RECORD ? 1 : -1];
+
+LogFile sample_log;
+unsigned char sample_csv;
+unsigned int sample_readings;
+
+// Create the /LOG= file and write its header. Returns 1 on success.
+int sampleOpen(char *spec) {
+    SampleHeader header;
+    char *ext = strchr(spec, '.');
+    
+    sample_csv = ext && startsWith(ext + 1, "CSV");
+    if (!logOpen(&sample_log, spec, sample_csv)) return 0;
+    if (sample_csv) {
+        logPut(&sample_log, "reading,second,poll_tstates,idle_tstates,polls\r\n", 48);
+    } else {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SAMPLE_MAGIC, 7);
+        header.version = SAMPLE_VERSION;
+        header.backend = rtc->name[0];
+        header.unit = hbios_rtc_unit;
+        header.cpu_hz = cpu_clock_hz;
+        header.edge = RTC_EDGE_TSTATES;
+        logPut(&sample_log, &header, CPM_RECORD);
+    }
+    logFlush(&sample_log);
+    sample_readings = 0;
+    return 1;
+}
+
+// Append the seconds of the last measureContinuous() reading
+void sampleLog(unsigned int gate_secs) {
+    unsigned int i;
+    uint16_t word;
+    uint32_t poll_milli = (uint32_t)(cont_poll * 1000.0 + 0.5);
+    uint32_t idle = (uint32_t)cont_idle;
+    
+    if (!sample_log.open) return;
+    sample_readings++;
+    if (!sample_csv) {
+        word = SAMPLE_READING;
+        logPut(&sample_log, &word, 2);
+        word = gate_secs;
+        logPut(&sample_log, &word, 2);
+        logPut(&sample_log, &poll_milli, 4);
+        logPut(&sample_log, &idle, 4);
+    }
+    for (i = 0; i < gate_secs; i++) {
+        if (sample_csv) {
+            logNumber(&sample_log, sample_readings, 0);
+            logPut(&sample_log, ",", 1);
+            logNumber(&sample_log, i + 1, 0);
+            logPut(&sample_log, ",", 1);
+            logNumber(&sample_log, poll_milli, 3);
+            logPut(&sample_log, ",", 1);
+            logNumber(&sample_log, idle, 0);
+            logPut(&sample_log, ",", 1);
+            logNumber(&sample_log, cont_reading[i], 0);
+            logPut(&sample_log, "\r\n", 2);
+        } else {
+            word = cont_reading[i] > 0xFFFE ? 0xFFFE : cont_reading[i];
+            logPut(&sample_log, &word, 2);
+        }
+    }
+    logFlush(&sample_log);
+}
+
+// Edge prediction for measureRtcTiming(). Once a reading has given the
+// second length, later readings idle through most of each second and poll
+// back to back only for the last PREDICT_WINDOW polls or so before the
+// edge is due. A second is then T = idle + count * c + e, with a few dozen
+// HBIOS calls instead of thousands, and the poll cost's error only
+// touches the few polls counted.
+#define PREDICT_WINDOW 32
+// Fewer polls than this in any second and the edge may have passed
+// during the idle, so the reading is dropped and the prediction relearnt
+#define PREDICT_MIN    (PREDICT_WINDOW / 4)
+
+typedef struct {
+    int (*poll)(void);      // Source the prediction holds for, 0 = none
+    unsigned char unit;     // HBIOS RTC unit it holds for
+    double hz;              // T-states per edge, from the last reading
+} EdgePrediction;
+
+EdgePrediction prediction;
+
+// One predicted reading. Returns T-states per RTC second, 0 if the
+// prediction did not hold or the gate failed.
+double measurePredicted(unsigned int gate_secs, PollCost *cost) {
+    RTC_Gate gate;
+    unsigned int i;
+    double idle;
+    
+    if (gate_secs > CONT_MAX_SECONDS) return 0;
+    idle = (prediction.hz - RTC_EDGE_TSTATES - PREDICT_WINDOW * cost->tstates) / RTC_IDLE_TSTATES(1);
+    if (idle < 0) idle = 0;
+    
+    conFlush();  // Nothing may reach the console during the gate
+    gate.seconds = gate_secs;
+    gate.spin = 0;
+    gate.poll = rtc->poll;
+    gate.marks = cont_marks;
+    gate.idle = (unsigned int)idle;
+    if (rtc_gate(&gate) != 0) return 0;
+    
+    for (i = 0; i < gate_secs; i++) {
+        if (cont_marks[i] < PREDICT_MIN) return 0;
+    }
+    cont_polls = gate.polls;
+    cont_poll = cost->tstates;
+    cont_poll_error = cost->error;
+    cont_idle = RTC_IDLE_TSTATES(gate.idle);
+    return gateHz(&gate, cost);
+}
+
+// Measure CPU T-states per RTC second over a gate_secs gate: predicted
+// when the current source has been timed before, otherwise (or if the
+// prediction fails) with one gate polling throughout, which then seeds
+// the prediction. resolution_ppm is the reading's error bar. Returns 0
+// on error.
+double measureRtcTiming(unsigned int gate_secs) {
+    PollCost *cost = rtcPollCost();
+    double hz;
+    
+    if (!cost) return 0;
+    if (prediction.poll == rtc->poll && prediction.unit == hbios_rtc_unit) {
+        hz = measurePredicted(gate_secs, cost);
+        if (hz != 0) {
+            prediction.hz = hz;
+            return hz;
+        }
+    }
+    
+    prediction.poll = 0;
+    hz = measureFull(gate_secs, cost);
+    if (hz == 0) return 0;
+    prediction.poll = rtc->poll;
+    prediction.unit = hbios_rtc_unit;
+    prediction.hz = hz;
+    return hz;
+}
+
+// The next reading of C, at most 'readings' of them still wanted, with
+// each of its seconds added to 'seconds' as a one-second sample. Once the
+// edge prediction holds, one gate spans as many readings as fit in
+// CONT_CHAIN_SECONDS and they are handed out one by one, each the sum of
+// its seconds' marks: consecutive readings in a chain share their edge
+// and leave no second unmeasured. Until then, or if a chain's prediction
+// fails, a reading is a measureRtcTiming() gate of its own. Set
+// cont_chain to 0 to drop what is left of a chain. Returns T-states per
+// RTC second and sets resolution_ppm, or returns 0 on error.
+double measureContinuous(unsigned int gate_secs, unsigned int readings, RunningStats *seconds) {
+    unsigned int i, chain = 1;
+    unsigned long polls = 0;
+    PollCost *cost;
+    double hz = 0, tstates;
+    
+    if (cont_next >= cont_chain) {
+        cont_chain = cont_next = 0;
+        if (prediction.poll == rtc->poll && prediction.unit == hbios_rtc_unit) {
+            chain = CONT_CHAIN_SECONDS / gate_secs;
+            if (chain > readings) chain = readings;
         }
-    } while (current_second == start_second);
+        if (chain > 1 && (cost = rtcPollCost()) != 0) {
+            hz = measurePredicted(gate_secs * chain, cost);
+            if (hz != 0) prediction.hz = hz;
+        }
+        if (hz == 0) {
+            chain = 1;
+            if (measureRtcTiming(gate_secs) == 0) return 0;
+        }
+        cont_chain = chain;
+    }
     
-    return (long)loop_count;
+    cont_reading = cont_marks + cont_next * gate_secs;
+    for (i = 0; i < gate_secs; i++) {
+        polls += cont_reading[i];
+        tstates = cont_reading[i] * cont_poll + cont_idle + RTC_EDGE_TSTATES;
+        statsAdd(seconds, ((double)cpu_clock_hz - tstates) * 1000000.0 / tstates);
+    }
+    if (cont_chain == 1) polls = cont_polls;  // Exact even if a mark saturated
+    cont_next++;
+    hz = polls * cont_poll / gate_secs + cont_idle + RTC_EDGE_TSTATES;
+    resolution_ppm = 1000000.0 * (cont_poll + polls * cont_poll_error) / (gate_secs * hz);
+    return hz;
 }
 
 // RTC Calibration using CPU clock as reference
 void calibrateRtc(void) {
     char key;
-    // Adjusted based on observed 13 seconds slow over 24 hours
-    // 13/86400 = 0.01505% slow, meaning RTC runs at 99.985% speed
-    // If RTC was properly calibrated, we'd expect ~5000 loops per second
-    // But since it's slow, we expect fewer loops: 5000 * 0.99985 = 4999.25
-    long expected_loops = 4999;  // Calibrated for observed -0.015% drift
+    unsigned int gate_secs;
+    double hz, ppm, last_resolution = 0;
+    RunningStats stats, second_stats;
     
     printStr("\r\n=== RTC Calibration Mode ===\r\n");
-    printStr("CPU Clock: 7,372,800 Hz\r\n");
-    printStr("Expected loops per RTC second: ");
-    printLong(expected_loops);
-    printStr("\r\n\r\n");
+    printCpuClock();
+    printRtcUnit();
+    printStr("\r\n");
     
     printStr("Instructions:\r\n");
     printStr("- Measures RTC timing accuracy against CPU clock\r\n");
-    printStr("- Shows percentage deviation from expected timing\r\n");
-    printStr("- Adjust capacitor value to get close to 0.00%\r\n");
-    printStr("- This will take time - BE PATIENT! Observe the flashing cursor behaviour.\r\n");
-    printStr("- The system is not frozen - it just takes time in between measurements,\r\n");
-    printStr("  especially with larger capacitors.\r\n");
+    printStr("- Readings are chained with no gap between them, one gate for up to\r\n");
+    printStr("  60 s of them; every RTC second also gives a one-second sample\r\n");
+    printStr("- Shows deviation in ppm (+ = RTC fast) and seconds per day\r\n");
+    printStr("- Longer gates give finer resolution (shown as +/- ppm)\r\n");
+    printStr("- Adjust capacitor value to get close to 0 ppm\r\n");
+    printStr("  (a DS3231 can be trimmed in software instead: O, with /RTC=I2C)\r\n");
     printStr("- Replace capacitors between value changes (or trim variable capacitor)\r\n");
     printStr("  and wait.\r\n");
-    printStr("- Press ESC to stop\r\n\r\n");
+    printStr("- Press ESC to stop (checked after each chain of readings)\r\n\r\n");
+    
+    gate_secs = selectGate();
+    if (gate_secs == 0) {
+        printStr("\r\nCalibration aborted.\r\n");
+        return;
+    }
     
+    statsReset(&stats);
+    statsReset(&second_stats);
+    cont_chain = 0;
     printStr("Starting calibration...\r\n");
     
     // Calibration loop
     while (1) {
         // Check for ESC key first
-        key = cRawIo();
+        key = readKey();
         if (key == 27) {
             printStr("\r\nCalibration stopped.\r\n");
+            storeCalibration(&stats, last_resolution);
             break;
         }
         
-        // Measure RTC timing
-        long loop_count = measureRtcTiming();
+        // Measure CPU T-states per RTC second
+        hz = measureContinuous(gate_secs, 0xFFFF, &second_stats);  // Until ESC
         
-        if (loop_count == 0x8000) {
+        if (hz == 0) {
             printStr("\rError reading RTC - retrying...        ");
             continue;
         }
+        sampleLog(gate_secs);
         
-        // Calculate deviation percentage
-        long diff = loop_count - expected_loops;
-        long pct_100 = (diff * 10000) / expected_loops;  // Percentage * 100 for 2 decimal places
+        // More CPU cycles per RTC second means longer RTC seconds (RTC slow)
+        ppm = ((double)cpu_clock_hz - hz) * 1000000.0 / hz;
         
         // Display the calibration result
-        printStr("\rRTC Calibration: ");
-        if (pct_100 > 0) {
+        printStr("\r\n");
+        printLong((unsigned long)(hz + 0.5));
+        printStr(" Hz/RTC s, poll ");
+        printLong((unsigned long)(cont_poll + 0.5));
+        printStr(" T: ");
+        if (ppm >= resolution_ppm) {
             printStr("FAST by ");
-        } else if (pct_100 < 0) {
+        } else if (ppm <= -resolution_ppm) {
             printStr("SLOW by ");
         } else {
             printStr("IN SYNC ");
         }
+        printFixed(ppm < 0 ? -ppm : ppm, 1);
+        printStr(" ppm +/- ");
+        printFixed(resolution_ppm, 1);
+        printStr(" (");
+        if (ppm > 0) printChar('+');
+        printFixed(ppm * 0.0864, 2);  // 86400 s/day / 10^6
+        printStr(" s/day)\r\n");
         
-        if (pct_100 != 0) {
-            printPercentage(pct_100 < 0 ? -pct_100 : pct_100);
-        } else {
-            printStr("0.00%");
-        }
-        
-        printStr("    ");
-        
-        for (int i = 0; i < 5000; i++);  // Brief pause
+        statsAdd(&stats, ppm);
+        last_resolution = resolution_ppm;
+        printStats(&stats);
+        printStr("  One-second samples:\r\n");
+        printStats(&second_stats);
     }
 }
 
-// Test RTC functionality
-void testRtc(void) {
-    RTC_Time test_time = {0, 0, 0, 0, 0, 0};
-    
-    printStr("\r\n=== RTC Hardware Test ===\r\n");
+// Choose the HBIOS RTC unit that every command uses
+void selectUnit(void) {
+    char key;
+    unsigned char saved = hbios_rtc_unit;
+    RTC_HbiosTime buf;
+    RTC_Time time;
     
-    if (!hbios_rtc_detect()) {
-        printStr("RTC not detected via HBIOS\r\n");
+    printStr("\r\n=== Select RTC Unit ===\r\n");
+    if (rtc != &hbios_backend) {
+        printStr("Units apply to the HBIOS backend only\r\n");
         return;
     }
-    
-    printStr("RTC hardware detected successfully\r\n");
-    
-    int result = hbios_rtc_get_time(&test_time);
-    if (result == 0 || result == 0xB8) {
-        convertFromBcd(&test_time);
-        printStr("Current RTC time: ");
-        printDateTime(&test_time);
+    // Each unit is read on its own, leaving the selected unit alone
+    for (buf.unit = 0; buf.unit < rtc_units; buf.unit++) {
+        printStr("  ");
+        printNum(buf.unit);
+        if (hbios_rtc_read(&buf) != 0) {
+            printStr(") not responding\r\n");
+            continue;
+        }
+        time.second = buf.second;
+        time.minute = buf.minute;
+        time.hour = buf.hour;
+        time.date = buf.date;
+        time.month = buf.month;
+        time.year = buf.year;
+        rtc_time_from_bcd(&time);
+        printStr(") responding, ");
+        printTimeOnly(&time);
         printStr("\r\n");
-        printStr("RTC hardware is functioning correctly\r\n");
-    } else {
-        printStr("Error reading RTC time\r\n");
+    }
+    
+    printStr("Unit (0-");
+    printNum(rtc_units - 1);
+    printStr(", ESC keeps ");
+    printNum(saved);
+    printStr("): ");
+    while (1) {
+        key = readKey();
+        if (key == 27) {
+            printStr("\r\n");
+            return;
+        }
+        if (key >= '0' && key < '0' + rtc_units) {
+            printChar(key);
+            printStr("\r\n");
+            hbios_rtc_unit = key - '0';
+            printRtcUnit();
+            printProfile();
+            return;
+        }
     }
 }
 
-// Display help
-void showHelp(void) {
-    printStr("\r\n");
+// Calibrate every HBIOS RTC unit in one loop. Each gate polls all the
+// units on every pass (rtc_gate_units), so one gate gives a reading per
+// unit over the same seconds. A unit's T-states between its marks are
+// its passes times the pass length, plus the edge paths of all units in
+// between; the pass length comes from each unit's timed poll cost.
+RunningStats unit_stats[RTC_MAX_UNITS];
+double unit_resolution[RTC_MAX_UNITS];
+
+void calibrateAllUnits(void) {
+    unsigned char saved = hbios_rtc_unit;
+    unsigned char unit, i;
+    unsigned int gate_secs, edges;
+    int result;
+    RTC_UnitGate gate;
+    RTC_UnitRecord *rec;
+    PollCost *cost;
+    double pass, pass_error, passes, hz, ppm;
     
-    if (ansi_enabled) {
-        // Draw top border (47 dashes + 2 plus signs = 49 total width)
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("+-----------------------------------------------+\r\n");
-        
-        // Title line (45 characters of content + 2 spaces = 47 total inside border)
-        printStr("|");
-        ansi_set_fg_color(ANSI_BRIGHT_WHITE);
-        ansi_set_bold();
-        printStr(" RTC Calibration Utility Help                  ");
-        ansi_reset_attributes();
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
-        
-        // Separator
-        printStr("+-----------------------------------------------+\r\n");
+    printStr("\r\n=== Calibrate All RTC Units ===\r\n");
+    if (rtc != &hbios_backend) {
+        printStr("Units apply to the HBIOS backend only\r\n");
+        return;
+    }
+    printCpuClock();
+    printNum(rtc_units);
+    printStr(" unit(s). Each gate polls every unit in turn; ESC (checked\r\n");
+    printStr("between gates) stops.\r\n\r\n");
+    
+    gate_secs = selectGate();
+    if (gate_secs == 0) {
+        printStr("\r\nCalibration aborted.\r\n");
+        return;
+    }
+    
+    // Units whose poll cost cannot be timed are left out of the gate
+    gate.units = 0;
+    pass = RTC_UNITS_PASS_TSTATES;
+    pass_error = 0;
+    for (unit = 0; unit < rtc_units; unit++) {
+        statsReset(&unit_stats[unit]);
+        hbios_rtc_unit = unit;
+        cost = rtcPollCost();
+        if (!cost) {
+            printStr("Unit ");
+            printNum(unit);
+            printStr(": error reading RTC\r\n");
+            continue;
+        }
+        pass += cost->tstates - RTC_POLL_TSTATES + RTC_UNITS_POLL_TSTATES;
+        pass_error += cost->error;
+        gate.unit[gate.units++].unit = unit;
+    }
+    hbios_rtc_unit = saved;
+    if (gate.units == 0) return;
+    
+    while (readKey() != 27) {
+        conFlush();  // Nothing may reach the console during the gate
+        gate.seconds = gate_secs;
+        result = rtc_gate_units(&gate);
+        printStr("\r\n");
+        if (result != 0) {
+            printStr("Error reading RTC\r\n");
+            continue;
+        }
+        for (i = 0; i < gate.units; i++) {
+            rec = &gate.unit[i];
+            unit = rec->unit;
+            edges = gate.seconds - rec->left;
+            passes = rec->last.passes - rec->first.passes;
+            hz = (passes * pass + (unsigned int)(rec->last.edges - rec->first.edges) *
+                  (double)RTC_UNITS_EDGE_TSTATES) / edges;
+            // One pass at each end, and the pass length's error
+            resolution_ppm = 1000000.0 * (pass + passes * pass_error) / (edges * hz);
+            ppm = ((double)cpu_clock_hz - hz) * 1000000.0 / hz;
+            statsAdd(&unit_stats[unit], ppm);
+            unit_resolution[unit] = resolution_ppm;
+            
+            printStr("Unit ");
+            printNum(unit);
+            printStr(": ");
+            printPpm(ppm);
+            printStr(" ppm +/- ");
+            printFixed(resolution_ppm, 1);
+            printStr(", mean ");
+            printPpm(unit_stats[unit].mean);
+            printStr(" sd ");
+            printFixed(statsStdDev(&unit_stats[unit]), 1);
+            printStr(" n=");
+            printLong(unit_stats[unit].n);
+            printStr("\r\n");
+        }
+    }
+    printStr("\r\nCalibration stopped.\r\n");
+    for (unit = 0; unit < rtc_units; unit++) {
+        if (unit_stats[unit].n == 0) continue;
+        hbios_rtc_unit = unit;
+        printStr("Unit ");
+        printNum(unit);
+        printStr(": ");
+        storeCalibration(&unit_stats[unit], unit_resolution[unit]);
+    }
+    hbios_rtc_unit = saved;
+}
+
+// Timer ticks across gate_secs RTC seconds. The counter is read at the
+// first RTC poll after each edge, so both ends carry the same poll delay.
+// Returns 0 on error or if the RTC goes two seconds without an edge.
+unsigned long ticksPerRtcGate(unsigned int gate_secs) {
+    HBIOS_Timer timer;
+    unsigned long first, edge;
+    unsigned int edges;
+    unsigned char polls;
+    int last, now;
+    
+    conFlush();
+    last = rtc->poll();
+    if (hbios_timer(&timer) != 0) return 0;
+    for (edges = 0; edges <= gate_secs; edges++) {
+        edge = timer.ticks;
+        for (polls = 1; (now = rtc->poll()) == last; polls++) {
+            // Check for a stall every 256 polls, off the edge path
+            if (polls == 0 && (hbios_timer(&timer) != 0 ||
+                               timer.ticks - edge > 2 * timer.rate)) return 0;
+        }
+        if (now & 0xFF00) return 0;
+        last = now;
+        if (hbios_timer(&timer) != 0) return 0;
+        if (edges == 0) first = timer.ticks;
+    }
+    return timer.ticks - first;
+}
+
+// Closed-loop trim of a DS3231's aging offset. Each pass measures the
+// error over AGING_READINGS readings, writes the offset that should
+// cancel it and measures again. The first step assumes the data sheet's
+// DS3231_AGING_PPM per LSB; later steps use the change measured since the
+// first pass, once it stands well clear of the measurement error.
+// The trim ends once the error is within the measurement error (see
+// calibrationError()) or rounds to no step, and the last pass is stored
+// in RTCCAL.DAT.
+#define AGING_READINGS   3
+#define AGING_MAX_PASSES 8
+
+void trimAging(void) {
+    signed char aging, first_aging = 0;
+    unsigned int gate_secs;
+    unsigned char pass;
+    double hz, ppm, error, change, first_ppm = 0, per_lsb = DS3231_AGING_PPM;
+    long step;
+    RunningStats stats;
+    
+    printStr("\r\n=== Trim DS3231 Aging Offset ===\r\n");
+    if (rtc != &ds3231_backend || ds3231_model != DS_MODEL_DS3231) {
+        printStr("Needs a DS3231 on the I2C bus: run RTCCALIB /RTC=I2C\r\n");
+        return;
+    }
+    if (ds3231_get_aging(&aging) != 0) {
+        printStr("Cannot read the aging register\r\n");
+        return;
+    }
+    printCpuClock();
+    printStr("Aging offset now ");
+    printFixed(aging, 0);
+    printStr(". Press ESC to stop (checked between readings).\r\n");
+    
+    gate_secs = selectGate();
+    if (gate_secs == 0) return;
+    
+    for (pass = 1; pass <= AGING_MAX_PASSES; pass++) {
+        statsReset(&stats);
+        while (stats.n < AGING_READINGS) {
+            if (readKey() == 27) {
+                printStr("\r\nTrim stopped, aging offset left at ");
+                printFixed(aging, 0);
+                printStr("\r\n");
+                return;
+            }
+            hz = measureRtcTiming(gate_secs);
+            if (hz == 0) {
+                printStr("Error reading RTC - retrying...\r\n");
+                continue;
+            }
+            statsAdd(&stats, ((double)cpu_clock_hz - hz) * 1000000.0 / hz);
+        }
+        ppm = stats.mean;
+        error = calibrationError(&stats, resolution_ppm);
         
-        // Command entries with colored letters (45 characters of content + 2 spaces = 47 total inside border)
-        printStr("| ");
-        ansi_set_fg_color(ANSI_YELLOW);
-        ansi_set_bold();
-        printStr("S");
-        ansi_reset_attributes();
-        ansi_set_fg_color(ANSI_WHITE);
-        printStr(" - Show current date/time                    ");
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
+        printStr("Offset ");
+        printFixed(aging, 0);
+        printStr(": ");
+        printPpm(ppm);
+        printStr(" ppm +/- ");
+        printFixed(error, 2);
+        printStr("\r\n");
         
-        printStr("| ");
-        ansi_set_fg_color(ANSI_YELLOW);
-        ansi_set_bold();
-        printStr("D");
-        ansi_reset_attributes();
-        ansi_set_fg_color(ANSI_WHITE);
-        printStr(" - Set RTC date                              ");
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
+        // Learn the real ppm per LSB, if the change is clear and plausible
+        if (pass == 1) {
+            first_aging = aging;
+            first_ppm = ppm;
+        } else if (aging != first_aging) {
+            change = first_ppm - ppm;
+            if (change > 4 * error || change < -4 * error) {
+                change /= aging - first_aging;
+                if (change > DS3231_AGING_PPM / 4 && change < DS3231_AGING_PPM * 4) per_lsb = change;
+            }
+        }
+        if (ppm < error && ppm > -error) {
+            printStr("Within the measurement error - a longer gate may trim further\r\n");
+            break;
+        }
         
-        printStr("| ");
-        ansi_set_fg_color(ANSI_YELLOW);
-        ansi_set_bold();
-        printStr("T");
-        ansi_reset_attributes();
-        ansi_set_fg_color(ANSI_WHITE);
-        printStr(" - Set RTC time (arrows/numbers for input)   ");
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
+        // RTC fast (ppm > 0) needs a larger offset, which slows it
+        step = (long)floor(ppm / per_lsb + 0.5);
+        if (step == 0) {
+            printStr("Within half a step of the aging offset\r\n");
+            break;
+        }
+        if (pass == AGING_MAX_PASSES) {
+            printStr("Not within the measurement error after the last pass\r\n");
+            break;
+        }
+        step += aging;
+        if (step > 127) step = 127;
+        if (step < -128) step = -128;
+        if (step == aging) {
+            printStr("Aging offset at its limit\r\n");
+            break;
+        }
+        aging = (signed char)step;
+        if (ds3231_set_aging(aging) != 0) {
+            printStr("Cannot write the aging register\r\n");
+            return;
+        }
+    }
+    
+    printStr("Aging offset set to ");
+    printFixed(aging, 0);
+    printStr(" (");
+    printFixed(per_lsb, 3);
+    printStr(" ppm per step)\r\n");
+    storeCalibration(&stats, resolution_ppm);
+}
+
+// Print one pairwise rate: "name: subject +n.n ppm +/- r vs reference"
+void printRate(char *name, char *subject, double ppm, double resolution, char *reference) {
+    printStr(name);
+    printStr(subject);
+    printChar(' ');
+    printPpm(ppm);
+    printStr(" ppm +/- ");
+    printFixed(resolution, 1);
+    printStr(" vs ");
+    printStr(reference);
+    printStr("\r\n");
+}
+
+// Three-way comparison of the RTC, the CPU clock and the HBIOS timer.
+// Each pair is measured directly. The odd one out is the source that
+// disagrees with both others while they agree with each other.
+void referenceCheck(void) {
+    HBIOS_Timer timer;
+    unsigned int gate_secs, timer_edges;
+    unsigned long ticks;
+    double rtc_hz, timer_hz, rtc_cpu, timer_cpu, rtc_timer;
+    double rtc_res, timer_res, ticks_res;
+    unsigned char off;
+    
+    printStr("\r\n=== Three-Way Reference Check ===\r\n");
+    if (hbios_timer(&timer) != 0 || timer.rate == 0) {
+        printStr("HBIOS timer not available\r\n");
+        return;
+    }
+    printCpuClock();
+    printStr("HBIOS timer: ");
+    printLong(timer.rate);
+    printStr(" ticks/s\r\n");
+    printStr("Times the RTC and the timer against CPU cycles, and counts timer\r\n");
+    printStr("ticks across RTC seconds. A reading takes about three gate lengths,\r\n");
+    printStr("after a one-off timing of each source's read cost.\r\n");
+    printStr("If the timer is derived from the CPU clock the two always agree.\r\n");
+    printStr("Press ESC to stop (checked between readings)\r\n\r\n");
+    
+    gate_secs = selectGate();
+    if (gate_secs == 0) {
+        printStr("\r\nReference check aborted.\r\n");
+        return;
+    }
+    // A gate counts at most 65535 edges: a long gate at a fast tick
+    // rate times the timer over fewer seconds than the RTC
+    if ((unsigned long)gate_secs * timer.rate > 0xFFFF) {
+        timer_edges = 0xFFFF / timer.rate * timer.rate;
+    } else {
+        timer_edges = gate_secs * timer.rate;
+    }
+    
+    while (readKey() != 27) {
+        rtc_hz = measureRtcTiming(gate_secs);
+        rtc_res = resolution_ppm;
+        timer_hz = measureEdges(&timer_cost, hbios_timer_poll, timer_edges,
+                                POLL_COST_SECS * timer.rate) * timer.rate;
+        timer_res = resolution_ppm;
+        ticks = ticksPerRtcGate(gate_secs);
+        if (rtc_hz == 0 || timer_hz == 0 || ticks == 0) {
+            printStr("Error reading RTC or timer - retrying\r\n");
+            continue;
+        }
         
-        printStr("| ");
-        ansi_set_fg_color(ANSI_YELLOW);
-        ansi_set_bold();
-        printStr("H");
-        ansi_reset_attributes();
-        ansi_set_fg_color(ANSI_WHITE);
-        printStr(" - Hardware test                             ");
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
+        // + = the first source runs fast against the second
+        rtc_cpu = ((double)cpu_clock_hz - rtc_hz) * 1000000.0 / rtc_hz;
+        timer_cpu = ((double)cpu_clock_hz - timer_hz) * 1000000.0 / timer_hz;
+        rtc_timer = ((double)gate_secs * timer.rate - ticks) * 1000000.0 / ticks;
+        ticks_res = 1000000.0 / ticks;
         
-        printStr("| ");
-        ansi_set_fg_color(ANSI_YELLOW);
-        ansi_set_bold();
-        printStr("C");
-        ansi_reset_attributes();
-        ansi_set_fg_color(ANSI_WHITE);
-        printStr(" - Calibrate RTC speed                       ");
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
+        printStr("\r\n");
+        printRate("CPU/RTC:   ", "RTC", rtc_cpu, rtc_res, "CPU");
+        printRate("CPU/timer: ", "timer", timer_cpu, timer_res, "CPU");
+        printRate("timer/RTC: ", "RTC", rtc_timer, ticks_res, "timer");
         
-        printStr("| ");
-        ansi_set_fg_color(ANSI_YELLOW);
-        ansi_set_bold();
-        printStr("A");
-        ansi_reset_attributes();
-        ansi_set_fg_color(ANSI_WHITE);
-        printStr(" - Toggle ANSI colours on/off                ");
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
+        // Bit set for each pair that disagrees beyond its resolution
+        off = (fabs(rtc_cpu) > rtc_res) | (fabs(timer_cpu) > timer_res) << 1 |
+              (fabs(rtc_timer) > ticks_res) << 2;
+        printStr("  ");
+        switch (off) {
+        case 0:
+            printStr("All three agree\r\n");
+            break;
+        case 5:
+            printStr("The RTC crystal is off\r\n");
+            break;
+        case 3:
+            printStr("The CPU clock (or its nominal value) is off\r\n");
+            break;
+        case 6:
+            printStr("The HBIOS timer is off\r\n");
+            break;
+        default:
+            printStr("Unclear - more than one source off, or a longer gate needed\r\n");
+            break;
+        }
+    }
+    printStr("\r\nReference check stopped.\r\n");
+}
+
+// Drift session log: one header record, then 16-byte samples, 8 per record.
+// Unused sample slots in the last record have polls == 0.
+#define DRIFT_FILE_NAME "RTCDRIFT"
+#define DRIFT_FILE_EXT  "LOG"
+#define DRIFT_MAGIC     "RTCDRIFT"
+#define DRIFT_PER_RECORD (CPM_RECORD / sizeof(DriftSample))
+
+// Fixed-width fields so the file reads the same on the host build
+#define DRIFT_HEADER_USED 14
+#define DRIFT_SAMPLE_USED 14
+
+typedef struct {
+    char magic[8];
+    uint32_t cpu_hz;         // Clock the session was measured against
+    char backend;            // First letter of the RTC backend name
+    uint8_t unit;            // HBIOS RTC unit
+    uint8_t reserved[CPM_RECORD - DRIFT_HEADER_USED];
+} DriftHeader;
+
+typedef struct {
+    uint32_t polls;          // Gate poll count
+    uint16_t seconds;        // Gate length in RTC seconds
+    uint8_t spin;            // Spin passes per poll
+    uint8_t reserved;
+    RTC_Time end;            // RTC time (BCD) read after the gate
+    uint8_t pad[16 - DRIFT_SAMPLE_USED];
+} DriftSample;
+
+// Compile-time layout checks: a negative array size fails the build
+typedef char drift_header_used[offsetof(DriftHeader, reserved) == DRIFT_HEADER_USED ? 1 : -1];
+typedef char drift_header_size[sizeof(DriftHeader) == CPM_RECORD ? 1 : -1];
+typedef char drift_sample_used[offsetof(DriftSample, pad) == DRIFT_SAMPLE_USED ? 1 : -1];
+typedef char drift_sample_size[CPM_RECORD % sizeof(DriftSample) == 0 ? 1 : -1];
+
+CPM_FCB drift_fcb;
+unsigned char drift_buf[CPM_RECORD];
+unsigned int drift_samples;
+LineFit drift_fit;
+RTC_Time drift_first, drift_last;   // First and last sample end times
+unsigned int drift_timed;           // Samples with a valid end time
+
+// Read or write one record of the drift log through drift_buf
+// Returns the BDOS status, 0 on success
+int driftRecord(unsigned int record, int write) {
+    drift_fcb.r0 = record & 0xFF;
+    drift_fcb.r1 = record >> 8;
+    drift_fcb.r2 = 0;
+    cpm_set_dma(drift_buf);
+    return write ? cpm_write_rand(&drift_fcb) : cpm_read_rand(&drift_fcb);
+}
+
+// Add a logged gate to the fit.
+// Every gate satisfies polls * (c + k) = seconds * (hz_per_rtc_second - e),
+// where c is the unknown poll cost, k the spin T-states and e the edge
+// path (RTC_EDGE_TSTATES). Scaled to nominal T-states,
+// y = seconds * (cpu_clock_hz - e) / polls is a straight line in k with
+// slope (cpu_clock_hz - e) / (hz_per_rtc_second - e), which is 1 for a
+// perfect RTC, and intercept c on the same scale. Slope - 1 is the RTC
+// error to within e / cpu_clock_hz of itself.
+void driftAddSample(DriftSample *sample) {
+    RTC_Time end;
+    
+    fitAdd(&drift_fit, RTC_SPIN_TSTATES(sample->spin),
+           (double)sample->seconds * (cpu_clock_hz - RTC_EDGE_TSTATES) / sample->polls);
+    drift_samples++;
+    
+    end = sample->end;
+    rtc_time_from_bcd(&end);
+    if (calValidTime(&end)) {
+        if (drift_timed++ == 0) drift_first = end;
+        drift_last = end;
+    }
+}
+
+// Open RTCDRIFT.LOG, offering to resume a session measured at this clock
+// through the same backend and unit (the poll cost is part of the fit)
+// Returns 1 if the log is ready for new samples, 0 on error or abort
+int driftOpen(void) {
+    DriftHeader *header = (DriftHeader *)drift_buf;
+    DriftSample *sample;
+    unsigned int record;
+    unsigned char slot;
+    char key;
+    
+    fitReset(&drift_fit);
+    drift_samples = 0;
+    drift_timed = 0;
+    initFcb(&drift_fcb, DRIFT_FILE_NAME, DRIFT_FILE_EXT);
+    
+    if (cpm_open(&drift_fcb) != CPM_DIR_ERROR) {
+        if (driftRecord(0, 0) == 0 &&
+            memcmp(header->magic, DRIFT_MAGIC, 8) == 0 &&
+            header->cpu_hz == cpu_clock_hz &&
+            header->backend == rtc->name[0] &&
+            header->unit == hbios_rtc_unit) {
+            printStr("Resume the session in " DRIFT_FILE_NAME "." DRIFT_FILE_EXT "? (Y/N/ESC) ");
+            while ((key = readKey()) == 0) { }
+            printChar(key);
+            printStr("\r\n");
+            if (key == 27) return 0;
+            
+            if (key == 'Y' || key == 'y') {
+                // Rebuild the fit; the last partial record stays in drift_buf
+                for (record = 1; driftRecord(record, 0) == 0; record++) {
+                    sample = (DriftSample *)drift_buf;
+                    for (slot = 0; slot < DRIFT_PER_RECORD; slot++, sample++) {
+                        if (sample->polls == 0) break;
+                        driftAddSample(sample);
+                    }
+                    if (slot < DRIFT_PER_RECORD) break;
+                }
+                printLong(drift_samples);
+                printStr(" samples loaded\r\n");
+                return 1;
+            }
+        } else {
+            printStr(DRIFT_FILE_NAME "." DRIFT_FILE_EXT " is from another clock or RTC - replacing it\r\n");
+        }
+        cpm_close(&drift_fcb);
+        cpm_delete(&drift_fcb);
+        initFcb(&drift_fcb, DRIFT_FILE_NAME, DRIFT_FILE_EXT);
+    }
+    
+    // New session
+    if (cpm_make(&drift_fcb) == CPM_DIR_ERROR) {
+        printStr("Cannot create " DRIFT_FILE_NAME "." DRIFT_FILE_EXT "\r\n");
+        return 0;
+    }
+    memset(drift_buf, 0, CPM_RECORD);
+    memcpy(header->magic, DRIFT_MAGIC, 8);
+    header->cpu_hz = cpu_clock_hz;
+    header->backend = rtc->name[0];
+    header->unit = hbios_rtc_unit;
+    if (driftRecord(0, 1) != 0) {
+        printStr("Error writing " DRIFT_FILE_NAME "." DRIFT_FILE_EXT "\r\n");
+        return 0;
+    }
+    memset(drift_buf, 0, CPM_RECORD);
+    return 1;
+}
+
+// Append a sample to the log, rewriting the current record.
+// The file is closed after every write so the directory is up to date
+// if the session is interrupted.
+int driftWrite(DriftSample *sample) {
+    unsigned char slot = drift_samples % DRIFT_PER_RECORD;
+    
+    if (slot == 0) memset(drift_buf, 0, CPM_RECORD);
+    memcpy(drift_buf + slot * sizeof(DriftSample), sample, sizeof(DriftSample));
+    if (driftRecord(1 + drift_samples / DRIFT_PER_RECORD, 1) != 0) return 0;
+    return cpm_close(&drift_fcb) != CPM_DIR_ERROR;
+}
+
+// Print the fit so far: RTC ppm and s/day with 95% confidence
+void driftReport(void) {
+    double slope, ppm, ci;
+    
+    printStr("#");
+    printLong(drift_samples);
+    if (drift_timed > 1) {
+        printStr(" over ");
+        printFixed(calDifference(&drift_last, &drift_first) / 3600.0, 2);
+        printStr(" h");
+    }
+    printStr(": ");
+    
+    // Need both spin settings and one spare degree of freedom
+    if (drift_fit.n < 3 || drift_fit.sxx == 0) {
+        printStr("collecting samples\r\n");
+        return;
+    }
+    
+    slope = fitSlope(&drift_fit);
+    ppm = (slope - 1.0) * 1000000.0;
+    ci = tValue95(drift_fit.n - 2) * fitSlopeError(&drift_fit) * 1000000.0;
+    
+    printStr("RTC ");
+    if (ppm > 0) printChar('+');
+    printFixed(ppm, 2);
+    printStr(" ppm +/- ");
+    printFixed(ci, 2);
+    printStr(" (95%), ");
+    if (ppm > 0) printChar('+');
+    printFixed(ppm * 0.0864, 3);  // 86400 s/day / 10^6
+    printStr(" s/day +/- ");
+    printFixed(ci * 0.0864, 3);
+    printStr(", poll ");
+    printLong((unsigned long)(fitIntercept(&drift_fit) / slope + 0.5));
+    printStr(" T\r\n");
+}
+
+// Unattended long-run drift measurement logged to RTCDRIFT.LOG
+void driftSession(void) {
+    DriftSample sample;
+    RTC_Gate gate;
+    unsigned int gate_secs;
+    int result;
+    
+    printStr("\r\n=== RTC Drift Session ===\r\n");
+    printCpuClock();
+    printRtcUnit();
+    printStr("Times back-to-back gates, alternating the spin delay, and fits a\r\n");
+    printStr("least-squares line to every sample logged so far. Leave it running\r\n");
+    printStr("for hours; ESC (checked between gates) stops and keeps the log.\r\n\r\n");
+    
+    if (!driftOpen()) return;
+    
+    gate_secs = selectGate();
+    if (gate_secs == 0) {
+        cpm_close(&drift_fcb);
+        printStr("\r\nDrift session aborted.\r\n");
+        return;
+    }
+    
+    driftReport();
+    
+    while (readKey() != 27) {
+        gate.seconds = gate_secs;
+        gate.spin = (drift_samples & 1) ? CALIB_SPIN : 0;
+        gate.marks = 0;
+        gate.idle = 0;
+        result = rtcGate(&gate);
+        if (result != 0) {
+            printStr("Error reading RTC - retrying...\r\n");
+            continue;
+        }
         
-        printStr("| ");
-        ansi_set_fg_color(ANSI_YELLOW);
-        ansi_set_bold();
-        printStr("?");
-        ansi_reset_attributes();
-        ansi_set_fg_color(ANSI_WHITE);
-        printStr(" - Show this help                            ");
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
+        memset(&sample, 0, sizeof(DriftSample));
+        sample.polls = gate.polls;
+        sample.seconds = gate.seconds;
+        sample.spin = gate.spin;
+        rtc->get_time(&sample.end);
         
-        printStr("| ");
-        ansi_set_fg_color(ANSI_YELLOW);
-        ansi_set_bold();
-        printStr("Q");
-        ansi_reset_attributes();
-        ansi_set_fg_color(ANSI_WHITE);
-        printStr(" - Quit programme                            ");
+        if (!driftWrite(&sample)) {
+            printStr("Error writing " DRIFT_FILE_NAME "." DRIFT_FILE_EXT "\r\n");
+            break;
+        }
+        driftAddSample(&sample);
+        driftReport();
+    }
+    
+    cpm_close(&drift_fcb);
+    printStr("\r\nDrift session stopped.\r\n");
+}
+
+// Micro-benchmark of the primitives that bound how sharply an edge can be
+// located. There is no hardware timer, so each primitive is run inside the
+// gate poll routine for one RTC second at a time and its cost is the rise
+// in T-states per poll over an empty routine, with T-states per RTC second
+// from a reference gate. The benchmark re-times the RTC's poll cost first
+// and stores it. Min and max are across those one-second runs.
+#define BENCH_RUNS 5
+
+RTC_Time bench_bcd = {0x59, 0x59, 0x23, 0x31, 0x12, 0x99};
+RTC_Time bench_work;
+void (*bench_fn)(void);
+
+// Every entry does the same copy, so the baseline cancels it
+void benchNone(void) { bench_work = bench_bcd; }
+void benchGetTime(void) { bench_work = bench_bcd; rtc->get_time(&bench_work); }
+void benchDetect(void) { bench_work = bench_bcd; rtc->detect(); }
+void benchConvert(void) { bench_work = bench_bcd; rtc_time_from_bcd(&bench_work); }
+void benchSeconds(void) { bench_work = bench_bcd; bench_work.minute = rtc_time_seconds(&bench_work); }
+void benchPrint(void) { bench_work = bench_bcd; printStr("Benchmark\r"); conFlush(); }
+void benchPutchar(void) {
+    char *p = "Benchmark\r";
+    
+    bench_work = bench_bcd;
+    while (*p) cpm_putchar(*p++);
+}
+
+typedef struct {
+    char *name;
+    void (*fn)(void);
+} BenchEntry;
+
+BenchEntry bench_entries[] = {
+    {"get_time          ", benchGetTime},
+    {"detect            ", benchDetect},
+    {"rtc_time_from_bcd ", benchConvert},
+    {"rtc_time_seconds  ", benchSeconds},
+    {"printStr 10 chars ", benchPrint},
+    {"BDOS 2 x 10 chars ", benchPutchar}
+};
+#define BENCH_COUNT 6
+#define BENCH_PRINT 4       // Buffered console entry
+#define BENCH_PUTCHAR 5     // Unbuffered console entry
+
+// Gate poll routine: the primitive under test, then the real poll
+int benchPoll(void) {
+    bench_fn();
+    return rtc->poll();
+}
+
+// T-states per poll with fn in the poll routine, over BENCH_RUNS gates
+// Returns 0 on error
+int benchMeasure(void (*fn)(void), double tstates_per_sec, RunningStats *stats) {
+    RTC_Gate gate;
+    unsigned char i;
+    
+    conFlush();
+    statsReset(stats);
+    bench_fn = fn;
+    for (i = 0; i < BENCH_RUNS; i++) {
+        gate.seconds = 1;
+        gate.spin = 0;
+        gate.poll = benchPoll;
+        gate.marks = 0;
+        gate.idle = 0;
+        if (rtc_gate(&gate) != 0) return 0;
+        statsAdd(stats, (tstates_per_sec - RTC_EDGE_TSTATES) / gate.polls);
+    }
+    return 1;
+}
+
+// One benchmark result row: T-states then microseconds
+void benchRow(char *name, double mean, double min, double max) {
+    double mhz = cpu_clock_hz / 1000000.0;
+    
+    printStr(name);
+    printFixed(mean, 0);
+    printStr("  ");
+    printFixed(min, 0);
+    printStr("  ");
+    printFixed(max, 0);
+    printStr(" T  ");
+    printFixed(mean / mhz, 1);
+    printStr(" us\r\n");
+}
+
+// Hidden B command
+void benchmark(void) {
+    RunningStats base, stats;
+    double tstates_per_sec;
+    double console_cost[2];
+    unsigned char i;
+    
+    printStr("\r\n=== Primitive Benchmark (");
+    printStr(rtc->name);
+    printStr(") ===\r\n");
+    printCpuClock();
+    printStr("Reference gate...\r\n");
+    
+    tstates_per_sec = 0;
+    if (retimeRtcCost()) tstates_per_sec = measureEdges(&rtc_cost, rtc->poll, 1, POLL_COST_SECS);
+    if (tstates_per_sec == 0 || !benchMeasure(benchNone, tstates_per_sec, &base)) {
+        printStr("Error reading RTC\r\n");
+        return;
+    }
+    
+    printLong((unsigned long)(tstates_per_sec + 0.5));
+    printStr(" T-states per RTC second\r\n\r\n");
+    printStr("Per call:          mean  min  max\r\n");
+    
+    // The poll routine alone: total per poll less the gate loop itself
+    benchRow("poll (seconds)    ", rtc_cost.tstates - RTC_POLL_TSTATES,
+             rtc_cost.tstates - RTC_POLL_TSTATES, rtc_cost.tstates - RTC_POLL_TSTATES);
+    
+    for (i = 0; i < BENCH_COUNT; i++) {
+        if (!benchMeasure(bench_entries[i].fn, tstates_per_sec, &stats)) {
+            printStr("\r\nError reading RTC\r\n");
+            return;
+        }
+        printStr("\r");
+        benchRow(bench_entries[i].name, stats.mean - base.mean,
+                 stats.min - base.mean, stats.max - base.mean);
+        if (i >= BENCH_PRINT) console_cost[i - BENCH_PRINT] = stats.mean - base.mean;
+    }
+    
+    // Console throughput, unbuffered and buffered
+    printStr("\r\nConsole bytes/s: BDOS 2 per byte ");
+    printFixed(10.0 * cpu_clock_hz / console_cost[BENCH_PUTCHAR - BENCH_PRINT], 0);
+    printStr(", buffered BDOS 9 ");
+    printFixed(10.0 * cpu_clock_hz / console_cost[0], 0);
+    printStr("\r\n");
+}
+
+// Test RTC functionality
+void testRtc(void) {
+    RTC_Time test_time = {0, 0, 0, 0, 0, 0};
+    
+    printStr("\r\n=== RTC Hardware Test ===\r\n");
+    
+    if (!rtc->detect()) {
+        printStr("RTC not detected via ");
+        printStr(rtc->name);
+        printStr("\r\n");
+        return;
+    }
+    
+    printStr("RTC hardware detected successfully\r\n");
+    
+    int result = rtc->get_time(&test_time);
+    if (result == 0 || result == 0xB8) {
+        rtc_time_from_bcd(&test_time);
+        printStr("Current RTC time: ");
+        printDateTime(&test_time);
+        printStr("\r\n");
+        printStr("RTC hardware is functioning correctly\r\n");
+    } else {
+        printStr("Error reading RTC time\r\n");
+    }
+}
+
+// Colour changes that are left out when ANSI is off
+void setColor(ansi_color_t color) {
+    if (ansi_enabled) ansi_set_fg_color(color);
+}
+
+void resetColor(void) {
+    if (ansi_enabled) ansi_reset_colors();
+}
+
+void printColor(ansi_color_t color, char *text) {
+    setColor(color);
+    printStr(text);
+    resetColor();
+}
+
+// Main menu and help: the menu text has ")" after the key letter and
+// ends with the separator to the next entry; the help label fits the
+// ANSI help box (HELP_LABEL_WIDTH).
+typedef struct {
+    char key;
+    char *menu;
+    char *help;
+} MenuEntry;
+
+#define HELP_LABEL_WIDTH 42
+
+MenuEntry menu_entries[] = {
+    { 'S', "S)how Date/Time - ", "Show current date/time" },
+    { 'D', "Set D)ate / ",       "Set RTC date" },
+    { 'T', "T)ime - ",           "Set RTC time (arrows/numbers for input)" },
+    { 'H', "H)ardware Test - ",  "Hardware test" },
+    { 'C', "C)alibrate - ",      "Calibrate RTC speed" },
+    { 'L', "L)ong Drift - ",     "Long drift log to RTCDRIFT.LOG, resumable" },
+    { 'R', "R)eference - ",      "Three-way check: RTC, CPU, HBIOS timer" },
+    { 'K', "K)lock - ",          "Set CPU clock (override HBIOS)" },
+    { 'U', "U)nit - ",           "Select the HBIOS RTC unit" },
+    { 'I', "I)nterleaved - ",    "Calibrate all RTC units, interleaved" },
+    { 'O', "O)ffset - ",         "Trim DS3231 aging offset (/RTC=I2C)" },
+    { 'A', "A)NSI Colours - ",   "Toggle ANSI colours on/off" },
+    { '?', "?)Help - ",          "Show this help" },
+    { 'Q', "Q)uit",              "Quit programme" }
+};
+
+#define MENU_ENTRIES (sizeof(menu_entries) / sizeof(menu_entries[0]))
+
+// The key letters are highlighted with one colour change each way
+void showMenu(void) {
+    unsigned char i;
+    char *p;
+    
+    printColor(ANSI_BRIGHT_BLUE, "\r\n--- Main Menu ---\r\n");
+    
+    for (i = 0; i < MENU_ENTRIES; i++) {
+        for (p = menu_entries[i].menu; *p; p++) {
+            if (ansi_enabled && p[1] == ')') {
+                ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
+                printChar(*p);
+                ansi_reset_colors();
+            } else {
+                printChar(*p);
+            }
+        }
+    }
+    printStr("\r\n");
+    
+    printColor(ANSI_BRIGHT_GREEN, "Command: ");
+}
+
+// Boxed line of the ANSI help: text in colour, padded to the box width
+void helpBoxLine(ansi_color_t color, char *text) {
+    unsigned char width = 0;
+    
+    printStr("|");
+    ansi_set_fg_color(color);
+    printStr(text);
+    while (text[width]) width++;
+    ansi_reset_colors();
+    while (width++ < HELP_LABEL_WIDTH + 5) printChar(' ');
+    ansi_set_fg_color(ANSI_BRIGHT_CYAN);
+    printStr("|\r\n");
+}
+
+// Display help
+void showHelp(void) {
+    unsigned char i, width;
+    
+    printStr("\r\n");
+    
+    if (ansi_enabled) {
+        // 47 columns inside the border: " k - " and the padded label
         ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
-        
-        // Bottom separator
         printStr("+-----------------------------------------------+\r\n");
-        
-        // Footer (45 characters of content + 2 spaces = 47 total inside border)
-        printStr("|");
-        ansi_set_fg_color(ANSI_BRIGHT_GREEN);
-        printStr(" For RC2014 with RomWBW HBIOS RTC support      ");
-        ansi_set_fg_color(ANSI_BRIGHT_CYAN);
-        printStr("|\r\n");
-        
-        // Bottom border
+        helpBoxLine(ANSI_BRIGHT_WHITE, " RTC Calibration Utility Help");
+        printStr("+-----------------------------------------------+\r\n");
+        for (i = 0; i < MENU_ENTRIES; i++) {
+            printStr("| ");
+            ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
+            printChar(menu_entries[i].key);
+            ansi_reset_colors();
+            printStr(" - ");
+            printStr(menu_entries[i].help);
+            for (width = 0; menu_entries[i].help[width]; width++) { }
+            while (width++ < HELP_LABEL_WIDTH) printChar(' ');
+            ansi_set_fg_color(ANSI_BRIGHT_CYAN);
+            printStr("|\r\n");
+        }
+        printStr("+-----------------------------------------------+\r\n");
+        helpBoxLine(ANSI_BRIGHT_GREEN, " For RC2014 with RomWBW HBIOS RTC support");
         printStr("+-----------------------------------------------+\r\n");
-        
         ansi_reset_colors();
     } else {
-        // Plain text version for non-ANSI terminals
         printStr("=== RTC Calibration Utility Help ===\r\n");
         printStr("Commands:\r\n");
-        printStr("  S - Show current date/time\r\n");
-        printStr("  D - Set RTC date\r\n");
-        printStr("  T - Set RTC time (arrows: UP/DOWN 10s, LEFT/RIGHT 1m, numbers: manual)\r\n");
-        printStr("  H - Hardware test\r\n");
-        printStr("  C - Calibrate RTC speed\r\n");
-        printStr("  A - Toggle ANSI colours on/off\r\n");
-        printStr("  ? - Show this help\r\n");
-        printStr("  Q - Quit programme\r\n");
-        printStr("\r\nFor RC2014 with RomWBW HBIOS RTC support\r\n");
+        for (i = 0; i < MENU_ENTRIES; i++) {
+            printStr("  ");
+            printChar(menu_entries[i].key);
+            printStr(" - ");
+            printStr(menu_entries[i].help);
+            printStr("\r\n");
+        }
+    }
+    
+    printStr("\r\nOptions: /HZ=n sets the CPU clock in Hz\r\n");
+    printStr("         /RTC=DS1302 reads the RC2014 DS1302 directly, not via HBIOS\r\n");
+    printStr("         /RTC=I2C reads a DS3231 or DS1307 on the RC2014 I2C bus\r\n");
+    printStr("         /UNIT=n selects HBIOS RTC unit n\r\n");
+    printStr("         /TRIM sets the RTCTRIM RSX from RTCCAL.DAT, /TRIM=OFF stops it\r\n");
+    printStr("         /LOG=file logs every second C measures (.CSV: as text)\r\n");
+    printStr("\r\nBatch:   RTCCALIB C [/G=s] [/N=n] [/Q] [/O=file] calibrates, RTCCALIB S\r\n");
+    printStr("         shows the time; CSV results and a CP/M 3 return code\r\n");
+    if (!ansi_enabled) printStr("\r\nFor RC2014 with RomWBW HBIOS RTC support\r\n");
+}
+
+// Text file for /O=, a copy of everything printed
+LogFile out_log;
+
+// Command-line mode: RTCCALIB C [/G=n] [/N=n] [/Q] [/O=file] calibrates
+// with n readings of an n-second gate; RTCCALIB S shows the time and the
+// stored calibration. Results are CSV lines, also written to the /O file:
+//   TIME,yyyy-mm-dd,hh:mm:ss
+//   CAL,ppm,error_ppm,n,cpu_hz         stored calibration (S)
+//   READING,i,hz,ppm,resolution_ppm    every reading (C)
+//   RESULT,ppm,error_ppm,n,s_per_day   mean of the readings (C)
+//   ERROR,text
+// /Q leaves out all other output.
+unsigned char batch_quiet;
+unsigned char batch_out;        // /O file open
+
+// Start and end a CSV line: it always goes out, and to the file
+void csvBegin(char *kind) {
+    con_route = CON_SCREEN | (batch_out ? CON_COPY : 0);
+    printStr(kind);
+}
+
+void csvEnd(void) {
+    printStr("\r\n");
+    con_route = batch_quiet ? 0 : CON_SCREEN;
+}
+
+void csvField(double value, unsigned char decimals) {
+    printChar(',');
+    printFixed(value, decimals);
+}
+
+void csvError(char *text) {
+    csvBegin("ERROR,");
+    printStr(text);
+    csvEnd();
+}
+
+// S: time and stored calibration. Returns 1 on success.
+int batchShow(void) {
+    RTC_Time now;
+    RTC_Profile *profile;
+    int status = rtc->get_time(&now);
+    
+    if (status != 0 && status != 0xB8) {
+        csvError("cannot read RTC");
+        return 0;
+    }
+    rtc_time_from_bcd(&now);
+    csvBegin("TIME,20");
+    printNum2(now.year);
+    printChar('-');
+    printNum2(now.month);
+    printChar('-');
+    printNum2(now.date);
+    printChar(',');
+    printTimeOnly(&now);
+    csvEnd();
+    
+    profile = profileLoad();
+    if (profile && profile->samples != 0) {
+        csvBegin("CAL");
+        csvField(profile->ppm_milli / 1000.0, 3);
+        csvField(profile->error_milli / 1000.0, 3);
+        csvField(profile->samples, 0);
+        csvField(profile->cpu_hz, 0);
+        csvEnd();
+    }
+    return 1;
+}
+
+// C: readings of the calibration measurement, stored in RTCCAL.DAT.
+// ESC stops early. Returns 1 on success.
+int batchCalibrate(unsigned int gate_secs, unsigned int readings) {
+    RunningStats stats, second_stats;
+    double hz, ppm, error, last_resolution = 0;
+    
+    if (gate_secs == 0 || gate_secs > CONT_MAX_SECONDS || readings == 0) {
+        csvError("bad /G= or /N=");
+        return 0;
+    }
+    statsReset(&stats);
+    statsReset(&second_stats);
+    cont_chain = 0;
+    while (stats.n < readings) {
+        if (readKey() == 27) {
+            csvError("stopped");
+            return 0;
+        }
+        hz = measureContinuous(gate_secs, readings - stats.n, &second_stats);
+        if (hz == 0) {
+            csvError("cannot read RTC");
+            return 0;
+        }
+        sampleLog(gate_secs);
+        ppm = ((double)cpu_clock_hz - hz) * 1000000.0 / hz;
+        statsAdd(&stats, ppm);
+        last_resolution = resolution_ppm;
+        
+        csvBegin("READING");
+        csvField(stats.n, 0);
+        csvField(hz, 1);
+        csvField(ppm, 3);
+        csvField(resolution_ppm, 3);
+        csvEnd();
     }
+    
+    error = calibrationError(&stats, last_resolution);
+    csvBegin("RESULT");
+    csvField(stats.mean, 3);
+    csvField(error, 3);
+    csvField(stats.n, 0);
+    csvField(stats.mean * 0.0864, 3);
+    csvEnd();
+    storeCalibration(&stats, last_resolution);
+    return 1;
 }
 
-void main(void) {
+int main(int argc, char *argv[]) {
     char command;
     int result;
+    int i;
+    unsigned long hz, unit;
+    char *unit_option = 0;
+    unsigned char trim_option = 0;
+    char batch_command = 0;
+    unsigned long batch_gate = 10, batch_readings = 10;
+    char *batch_file = 0;
+    char *log_file = 0;
+    char *bad_option = 0;
     
     // Disable ANSI for now until we can properly detect support
     g_ansi_capability = ANSI_NOT_SUPPORTED;
     ansi_enabled = 0;
     
+    // A command letter first runs that command without the menu
+    if (argc > 1 && argv[1][0] != '/') {
+        batch_command = argv[1][0] & 0x5F;
+        for (i = 2; i < argc; i++) {
+            if (startsWith(argv[i], "/Q")) batch_quiet = 1;
+        }
+        con_route = batch_quiet ? 0 : CON_SCREEN;
+    }
+    
     if (ansi_enabled) {
         ansi_clear_screen();
         ansi_home_cursor();
@@ -862,137 +2369,156 @@ void main(void) {
     printStr("For RC2014 with RomWBW HBIOS RTC support\r\n");
     printStr("========================================\r\n");
 
-    // Detect RTC hardware via HBIOS
-    if (!hbios_rtc_detect()) {
-        printStr("ERROR: RTC not available via HBIOS!\r\n");
+    // Options: /HZ=n CPU clock, /RTC=HBIOS, DS1302 or I2C backend,
+    // /UNIT=n HBIOS RTC unit, /TRIM or /TRIM=OFF drift trim RSX. An
+    // option that does not parse, or is not known, is ignored in the menu
+    // and fails a command-line command.
+#ifndef CPU_HZ
+    detectCpuClock();
+#endif
+    for (i = 1; i < argc; i++) {
+        if (startsWith(argv[i], "/HZ=")) {
+            if (!parseULong(argv[i] + 4, &hz) || !overrideCpuClock(hz)) {
+                bad_option = argv[i];
+            }
+        } else if (startsWith(argv[i], "/RTC=DS")) {
+            rtc = &ds1302_backend;
+        } else if (startsWith(argv[i], "/RTC=I2C")) {
+            rtc = &ds3231_backend;
+        } else if (startsWith(argv[i], "/RTC=HB")) {
+            rtc = &hbios_backend;
+        } else if (startsWith(argv[i], "/UNIT=")) {
+            unit_option = argv[i];
+        } else if (startsWith(argv[i], "/TRIM=OFF")) {
+            trim_option = 2;
+        } else if (startsWith(argv[i], "/TRIM")) {
+            trim_option = 1;
+        } else if (startsWith(argv[i], "/G=")) {
+            if (!parseULong(argv[i] + 3, &batch_gate)) bad_option = argv[i];
+        } else if (startsWith(argv[i], "/N=")) {
+            if (!parseULong(argv[i] + 3, &batch_readings)) bad_option = argv[i];
+        } else if (startsWith(argv[i], "/O=")) {
+            batch_file = argv[i] + 3;
+        } else if (startsWith(argv[i], "/LOG=")) {
+            log_file = argv[i] + 5;
+        } else if (!startsWith(argv[i], "/Q") && (i > 1 || !batch_command)) {
+            bad_option = argv[i];  // Not the command letter either
+        }
+    }
+    
+    // The unit is checked against the units HBIOS reports
+    enumerateRtcUnits();
+    if (unit_option) {
+        if (parseULong(unit_option + 6, &unit) && unit < rtc_units) {
+            hbios_rtc_unit = unit;
+        } else {
+            bad_option = unit_option;
+        }
+    }
+    if (bad_option && !batch_command) {
+        printStr("Ignoring invalid option ");
+        printStr(bad_option);
+        printStr("\r\n");
+    }
+    
+    // Detect RTC hardware
+    if (!rtc->detect()) {
+        printStr("ERROR: RTC not available via ");
+        printStr(rtc->name);
+        printStr("!\r\n");
         printStr("Please check:\r\n");
         printStr("- RTC hardware is properly configured in RomWBW\r\n");
         printStr("- RTC driver is loaded in HBIOS\r\n");
         printStr("- RTC hardware is functioning\r\n");
-        return;
+        printStr("- Or try RTCCALIB /RTC=DS1302 (RC2014 RTC module on port C0h)\r\n");
+        printStr("  or RTCCALIB /RTC=I2C (DS3231 or DS1307 on I2C port 0Ch)\r\n");
+        if (batch_command) csvError("RTC not available");
+        conFlush();
+        cpm_set_return(CPM_RETURN_ERROR);
+        return 1;
     }
     
-    printStr("RTC detected via HBIOS and ready.\r\n");
+    printStr("RTC detected via ");
+    printStr(rtc->name);
+    printStr(" and ready.\r\n");
+    printRtcUnit();
     
-    // Main menu loop
-    while (1) {
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_BLUE);
-            ansi_set_bold();
-        }
-        printStr("\r\n--- Main Menu ---\r\n");
-        
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_WHITE);
-            ansi_reset_attributes();
-        }
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
-        }
-        printStr("S");
-        if (ansi_enabled) {
-            ansi_reset_colors();
-        }
-        printStr(")how Date/Time - Set ");
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
-        }
-        printStr("D");
-        if (ansi_enabled) {
-            ansi_reset_colors();
-        }
-        printStr(")ate / ");
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
-        }
-        printStr("T");
-        if (ansi_enabled) {
-            ansi_reset_colors();
-        }
-        printStr(")ime - ");
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
-        }
-        printStr("H");
-        if (ansi_enabled) {
-            ansi_reset_colors();
-        }
-        printStr(")ardware Test - ");
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
-        }
-        printStr("C");
-        if (ansi_enabled) {
-            ansi_reset_colors();
-        }
-        printStr(")alibrate - ");
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
-        }
-        printStr("A");
-        if (ansi_enabled) {
-            ansi_reset_colors();
-        }
-        printStr(")NSI Colours - ");
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
-        }
-        printStr("?");
-        if (ansi_enabled) {
-            ansi_reset_colors();
-        }
-        printStr(")Help - ");
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_YELLOW);
-        }
-        printStr("Q");
-        if (ansi_enabled) {
-            ansi_reset_colors();
+    printCpuClock();
+    printProfile();
+    
+    if (log_file && !sampleOpen(log_file)) {
+        printStr("Cannot create /LOG= file\r\n");
+    }
+    
+    // /TRIM sets the drift trim RSX and exits
+    if (trim_option != 0) {
+        result = setTrim(trim_option == 1);
+        conFlush();
+        cpm_set_return(result ? CPM_RETURN_OK : CPM_RETURN_ERROR);
+        return result ? 0 : 1;
+    }
+    
+    if (batch_command) {
+        result = 0;
+        log_text = &out_log;    // CSV lines are copied while batch_out is set
+        con_copy = logTextChar;
+        if (bad_option) {
+            csvBegin("ERROR,");
+            printStr("invalid option ");
+            printStr(bad_option);
+            csvEnd();
+        } else if (batch_file && !(batch_out = logOpen(&out_log, batch_file, 1))) {
+            csvError("cannot create /O= file");
+        } else if (log_file && !sample_log.open) {
+            csvError("cannot create /LOG= file");
+        } else if (batch_command == 'C') {
+            result = batchCalibrate(batch_gate > 0xFFFF ? 0 : batch_gate,
+                                    batch_readings > 0xFFFF ? 0 : batch_readings);
+        } else if (batch_command == 'S') {
+            result = batchShow();
+        } else {
+            csvError("unknown command");
         }
-        printStr(")uit\r\n");
-        
-        if (ansi_enabled) {
-            ansi_set_fg_color(ANSI_BRIGHT_GREEN);
+        if (sample_log.open && !logClose(&sample_log)) {
+            csvError("cannot write /LOG= file");
+            result = 0;
         }
-        printStr("Command: ");
-        
-        if (ansi_enabled) {
-            ansi_reset_colors();
+        if (batch_out) {
+            batch_out = 0;
+            if (!logClose(&out_log)) {
+                csvError("cannot write /O= file");
+                result = 0;
+            }
         }
+        conFlush();
+        cpm_set_return(result ? CPM_RETURN_OK : CPM_RETURN_ERROR);
+        return result ? 0 : 1;
+    }
+    
+    // Main menu loop
+    while (1) {
+        showMenu();
         
         // Wait for command
         command = 0;
-        while ((command = cRawIo()) == 0) { }
+        while ((command = readKey()) == 0) { }
         printChar(command);
         printStr("\r\n");
         
         switch (command) {
             case 'S':
             case 's':
-                result = hbios_rtc_get_time(&datetime);
+                result = rtc->get_time(&datetime);
                 if (result == 0 || result == 0xB8) {
-                    convertFromBcd(&datetime);
-                    if (ansi_enabled) {
-                        ansi_set_fg_color(ANSI_CYAN);
-                    }
+                    rtc_time_from_bcd(&datetime);
+                    setColor(ANSI_CYAN);
                     printStr("Current time: ");
-                    if (ansi_enabled) {
-                        ansi_set_fg_color(ANSI_BRIGHT_WHITE);
-                        ansi_set_bold();
-                    }
+                    setColor(ANSI_BRIGHT_WHITE);    // Bright is bold
                     printDateTime(&datetime);
-                    if (ansi_enabled) {
-                        ansi_reset_colors();
-                    }
+                    resetColor();
                     printStr("\r\n");
                 } else {
-                    if (ansi_enabled) {
-                        ansi_set_fg_color(ANSI_BRIGHT_RED);
-                    }
-                    printStr("Error reading RTC time\r\n");
-                    if (ansi_enabled) {
-                        ansi_reset_colors();
-                    }
+                    printColor(ANSI_BRIGHT_RED, "Error reading RTC time\r\n");
                 }
                 break;
                 
@@ -1016,6 +2542,41 @@ void main(void) {
                 calibrateRtc();
                 break;
                 
+            case 'B':
+            case 'b':
+                benchmark();
+                break;
+                
+            case 'L':
+            case 'l':
+                driftSession();
+                break;
+                
+            case 'R':
+            case 'r':
+                referenceCheck();
+                break;
+                
+            case 'U':
+            case 'u':
+                selectUnit();
+                break;
+                
+            case 'I':
+            case 'i':
+                calibrateAllUnits();
+                break;
+                
+            case 'O':
+            case 'o':
+                trimAging();
+                break;
+                
+            case 'K':
+            case 'k':
+                setCpuClock();
+                break;
+                
             case 'A':
             case 'a':
                 ansi_enabled = !ansi_enabled;
@@ -1034,8 +2595,12 @@ void main(void) {
                 
             case 'Q':
             case 'q':
+                if (sample_log.open && !logClose(&sample_log)) {
+                    printStr("Error writing /LOG= file\r\n");
+                }
                 printStr("Goodbye!\r\n");
-                return;
+                conFlush();
+                return 0;
                 
             default:
                 printStr("Unknown command. Press '?' for help.\r\n");
@@ -0,0 +1,45 @@
+#include "rtc.h"
+#include "ds1302.h"
+#include "ds3231.h"
+
+// HBIOS entry points read their argument from HL, which a call through a
+// function pointer does not set up, so the table holds plain C wrappers.
+
+int hbiosGetTime(RTC_Time *time) {
+    return hbios_rtc_get_time(time);
+}
+
+int hbiosSetTime(const RTC_Time *time) {
+    return hbios_rtc_set_time(time);
+}
+
+RTC_Backend hbios_backend = {
+    "HBIOS",
+    hbios_rtc_detect,
+    hbiosGetTime,
+    hbiosSetTime,
+    hbios_rtc_poll
+};
+
+RTC_Backend ds1302_backend = {
+    "DS1302 direct",
+    ds1302_detect,
+    ds1302_get_time,
+    ds1302_set_time,
+    ds1302_get_seconds
+};
+
+RTC_Backend ds3231_backend = {
+    "I2C DS3231/DS1307",
+    ds3231_detect,
+    ds3231_get_time,
+    ds3231_set_time,
+    ds3231_get_seconds
+};
+
+RTC_Backend *rtc = &hbios_backend;
+
+int rtcGate(RTC_Gate *gate) {
+    gate->poll = rtc->poll;
+    return rtc_gate(gate);
+}
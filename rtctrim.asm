@@ -0,0 +1,261 @@
+;
+; RTCTRIM.RSX - resident drift trim for CP/M 3
+;
+; Steps an HBIOS RTC by one second every so many HBIOS timer ticks, to
+; cancel the drift RTCCALIB measured. Attach it to RTCCALIB with
+; GENCOM RTCCALIB RTCTRIM; it is loaded the first time RTCCALIB runs and
+; stays resident. RTCCALIB /TRIM then sets it from RTCCAL.DAT.
+;
+; The RSX sits in front of the BDOS. A call passes through in 84
+; T-states; every TRIM_CALLS calls it reads the timer instead (one HBIOS
+; call). When a step is due it waits for the next RTC second edge, so
+; about half a second once in many hours, and writes the time read at
+; the edge straight back with the seconds one up or down. The step lands
+; on the edge and nothing of the second is lost. Edges to 00 and 59 are
+; passed over, so a step never carries into the minute.
+;
+; BDOS 60 (call RSX) with DE -> { TRIM_FUNC, 1, config pointer }:
+; config +0 set (byte), +1 step (byte), +2 unit (byte), +3 interval
+; (long), +7 steps taken (word), +9 loaded (byte). With set <> 0 the
+; step, unit and interval are taken and the interval restarts. Either
+; way the RSX's figures are copied back and loaded set to 1. A step of
+; 01h adds a second and 99h (BCD -1) takes one; 0 stops the trim.
+;
+; Built as a page-relocatable file: see the rsx target in the Makefile.
+;
+
+	INCLUDE	"hbios.inc"
+
+BDOS_RSX	EQU	60		; BDOS call RSX
+TRIM_FUNC	EQU	7Ah		; Our BDOS 60 function number
+TRIM_CALLS	EQU	256		; BDOS calls between timer reads
+
+; RSX prefix - the loader fills in next and prev
+	DB	0, 0, 0, 0, 0, 0	; Serial number
+	JP	_trim_entry
+_trim_next:
+	JP	0			; Next RSX or the BDOS
+	DW	0			; Previous module
+	DB	0			; Remove flag: stay resident
+	DB	0			; Non-banked flag
+	DB	"RTCTRIM "		; Name
+	DB	0			; Loader flag
+	DB	0, 0
+
+;
+; BDOS entry: C = function, DE = parameter, both passed on unchanged
+;
+_trim_entry:
+	LD	A, C			; 4
+	CP	BDOS_RSX		; 7
+	JR	Z, _trim_rsx		; 7
+_trim_count:
+	LD	HL, (TRIM_COUNT)	; 16
+	DEC	HL			; 6
+	LD	(TRIM_COUNT), HL	; 16
+	LD	A, H			; 4
+	OR	L			; 4
+	JP	NZ, _trim_next		; 10, then 10 for the JP there
+
+	; Timer check, on a stack of our own
+	LD	(TRIM_SP), SP
+	LD	SP, TRIM_STACK
+	PUSH	BC
+	PUSH	DE
+	PUSH	IX
+	PUSH	IY
+	CALL	_trim_check
+	POP	IY
+	POP	IX
+	POP	DE
+	POP	BC
+	LD	SP, (TRIM_SP)
+	JP	_trim_next
+
+_trim_rsx:
+	LD	A, (DE)			; RSX function number
+	CP	TRIM_FUNC
+	JR	NZ, _trim_count		; Not for us
+
+	LD	(TRIM_SP), SP
+	LD	SP, TRIM_STACK
+	PUSH	BC
+	PUSH	DE
+	PUSH	IX
+	PUSH	IY
+	CALL	_trim_config
+	POP	IY
+	POP	IX
+	POP	DE
+	POP	BC
+	LD	SP, (TRIM_SP)
+	LD	HL, 0			; Return 0 (done)
+	XOR	A
+	RET
+
+;
+; Take and report the settings. DE points to the RSX parameter block.
+;
+_trim_config:
+	EX	DE, HL
+	INC	HL
+	INC	HL
+	LD	E, (HL)
+	INC	HL
+	LD	D, (HL)
+	EX	DE, HL			; HL = config
+	PUSH	HL
+	LD	A, (HL)
+	INC	HL
+	OR	A
+	JR	Z, _trim_report		; Only reading back
+	LD	DE, TRIM_STEP		; Step, unit, interval
+	LD	BC, 6
+	LDIR
+	CALL	_trim_restart
+_trim_report:
+	POP	DE
+	INC	DE
+	LD	HL, TRIM_STEP		; Step, unit, interval, steps taken
+	LD	BC, 8
+	LDIR
+	LD	A, 1
+	LD	(DE), A			; Loaded
+	RET
+
+; Next step due one interval from now
+_trim_restart:
+	CALL	_trim_timer
+	JR	NZ, _trim_off
+	LD	(TRIM_DUE), HL
+	LD	(TRIM_DUE+2), DE
+	JR	_trim_advance
+
+;
+; Every TRIM_CALLS BDOS calls: step the RTC if the timer says it is due
+;
+_trim_check:
+	LD	HL, TRIM_CALLS
+	LD	(TRIM_COUNT), HL
+	LD	A, (TRIM_STEP)
+	OR	A
+	RET	Z			; Trim off
+	CALL	_trim_timer
+	RET	NZ
+
+	; Due when ticks - due is not negative (the counter may wrap)
+	LD	BC, (TRIM_DUE)
+	OR	A
+	SBC	HL, BC
+	EX	DE, HL
+	LD	BC, (TRIM_DUE+2)
+	SBC	HL, BC
+	RET	M
+
+	CALL	_trim_step
+	JR	NZ, _trim_off		; RTC not answering - stop
+	LD	HL, (TRIM_TAKEN)
+	INC	HL
+	LD	(TRIM_TAKEN), HL
+
+	; One interval on from the last due tick, so a long gap between
+	; BDOS calls is caught up a step per check
+_trim_advance:
+	LD	HL, (TRIM_DUE)
+	LD	BC, (TRIM_INTERVAL)
+	ADD	HL, BC
+	LD	(TRIM_DUE), HL
+	LD	HL, (TRIM_DUE+2)
+	LD	BC, (TRIM_INTERVAL+2)
+	ADC	HL, BC
+	LD	(TRIM_DUE+2), HL
+	RET
+
+_trim_off:
+	XOR	A
+	LD	(TRIM_STEP), A
+	RET
+
+;
+; Wait for an RTC second edge and step the time just read by TRIM_STEP
+; Returns: Z on success
+;
+_trim_step:
+	CALL	_trim_read
+	RET	NZ
+	LD	A, (TRIM_BUF+5)		; Seconds (HBIOS byte 5)
+	LD	(TRIM_LAST), A
+_trim_wait_edge:
+	LD	BC, 0			; Timeout: 65536 reads
+_trim_wait:
+	PUSH	BC
+	CALL	_trim_read
+	POP	BC
+	RET	NZ
+	LD	A, (TRIM_BUF+5)
+	LD	HL, TRIM_LAST
+	CP	(HL)
+	JR	NZ, _trim_edge
+	DEC	BC
+	LD	A, B
+	OR	C
+	JR	NZ, _trim_wait
+	INC	A			; NZ: the RTC is not ticking
+	RET
+
+_trim_edge:
+	LD	(HL), A			; New second
+	CP	01h
+	JR	C, _trim_wait_edge	; 00: a step down would borrow
+	CP	59h
+	JR	NC, _trim_wait_edge	; 59: a step up would carry
+	LD	HL, TRIM_STEP
+	ADD	A, (HL)			; 01h up, 99h down
+	DAA
+	LD	(TRIM_BUF+5), A
+
+	LD	B, BF_RTCSET		; HBIOS RTC set time function
+	LD	A, (TRIM_UNIT)
+	LD	C, A
+	LD	D, A
+	LD	HL, TRIM_BUF
+	RST	08
+	OR	A
+	RET
+
+; Read the RTC into TRIM_BUF (HBIOS order, seconds last)
+; Returns: Z on success
+_trim_read:
+	LD	B, BF_RTC		; HBIOS RTC get time function
+	LD	A, (TRIM_UNIT)		; Unit in C and D, as rtc.asm
+	LD	C, A
+	LD	D, A
+	LD	HL, TRIM_BUF
+	RST	08
+	OR	A
+	RET	Z
+	CP	0B8h			; Tolerated status, as rtc.asm
+	RET
+
+; Read the HBIOS timer: DE:HL = ticks
+; Returns: Z on success
+_trim_timer:
+	LD	B, BF_SYSGET
+	LD	C, BF_SYSGET_TIMER
+	RST	08
+	OR	A
+	RET
+
+; Settings, in the order of the config block from +1
+TRIM_STEP:		DB	0	; 01h, 99h, or 0 = off
+TRIM_UNIT:		DB	0	; HBIOS RTC unit
+TRIM_INTERVAL:		DW	0, 0	; Timer ticks between steps
+TRIM_TAKEN:		DW	0	; Steps taken since loading
+
+TRIM_COUNT:		DW	TRIM_CALLS	; BDOS calls to the next check
+TRIM_DUE:		DW	0, 0	; Timer tick of the next step
+TRIM_LAST:		DB	0	; Last BCD seconds value seen
+TRIM_BUF:		DS	6	; HBIOS time buffer
+TRIM_SP:		DW	0	; Caller's stack
+			DS	48
+TRIM_STACK:
@@ -0,0 +1,18 @@
+#ifndef RTCTRIM_H
+#define RTCTRIM_H
+
+// Drift trim RSX (rtctrim.asm), set up through BDOS 60
+#define TRIM_FUNC       0x7A
+#define TRIM_STEP_UP    0x01    // BCD +1: the RTC is slow
+#define TRIM_STEP_DOWN  0x99    // BCD -1: the RTC is fast
+
+typedef struct {
+    unsigned char set;          // 1: take step, unit and interval
+    unsigned char step;         // TRIM_STEP_UP or _DOWN, 0 = off
+    unsigned char unit;         // HBIOS RTC unit
+    unsigned long interval;     // HBIOS timer ticks between steps
+    unsigned int taken;         // Back: steps taken since loading
+    unsigned char loaded;       // Back: 1 if the RSX answered
+} TRIM_Config;
+
+#endif // RTCTRIM_H
@@ -0,0 +1,132 @@
+#include "stats.h"
+#include <math.h>
+#include <string.h>
+
+// Running statistics
+
+void statsReset(RunningStats *stats) {
+    memset(stats, 0, sizeof(RunningStats));
+}
+
+// Sample added 'back' samples ago (0 = newest); needs back < n
+double statsHistory(RunningStats *stats, unsigned char back) {
+    return stats->history[(stats->head + STATS_HISTORY - 1 - back) % STATS_HISTORY];
+}
+
+// Mean of 'count' samples starting 'back' samples ago, going back in time
+double statsWindowMean(RunningStats *stats, unsigned char back, unsigned char count) {
+    double sum = 0;
+    unsigned char i;
+    
+    for (i = 0; i < count; i++) sum += statsHistory(stats, back + i);
+    return sum / count;
+}
+
+void statsAdd(RunningStats *stats, double sample) {
+    double delta, diff;
+    unsigned char level, m;
+    
+    // Welford mean and variance
+    stats->n++;
+    delta = sample - stats->mean;
+    stats->mean += delta / stats->n;
+    stats->m2 += delta * (sample - stats->mean);
+    
+    if (stats->n == 1 || sample < stats->min) stats->min = sample;
+    if (stats->n == 1 || sample > stats->max) stats->max = sample;
+    
+    stats->history[stats->head] = sample;
+    stats->head = (stats->head + 1) % STATS_HISTORY;
+    
+    // Overlapping Allan variance: at each level, the difference between the
+    // means of the two most recent adjacent runs of m samples
+    for (level = 0, m = 1; level < STATS_ALLAN_LEVELS; level++, m <<= 1) {
+        if (stats->n < 2 * m) break;
+        diff = statsWindowMean(stats, 0, m) - statsWindowMean(stats, m, m);
+        stats->allan_sum[level] += diff * diff;
+        stats->allan_n[level]++;
+    }
+}
+
+double statsStdDev(RunningStats *stats) {
+    if (stats->n < 2) return 0;
+    return sqrt(stats->m2 / (stats->n - 1));
+}
+
+// Median of the most recent samples, up to STATS_MEDIAN_WINDOW of them
+double statsMedian(RunningStats *stats) {
+    double window[STATS_MEDIAN_WINDOW];
+    double value;
+    unsigned char count, i, j;
+    
+    count = stats->n < STATS_MEDIAN_WINDOW ? stats->n : STATS_MEDIAN_WINDOW;
+    if (count == 0) return 0;
+    
+    // Insertion sort - the window is tiny
+    for (i = 0; i < count; i++) {
+        value = statsHistory(stats, i);
+        for (j = i; j > 0 && window[j - 1] > value; j--) {
+            window[j] = window[j - 1];
+        }
+        window[j] = value;
+    }
+    
+    if (count & 1) return window[count / 2];
+    return (window[count / 2 - 1] + window[count / 2]) / 2;
+}
+
+// Overlapping Allan deviation at 2^level sample intervals
+// Returns -1 until there are enough samples
+double statsAllan(RunningStats *stats, unsigned char level) {
+    if (level >= STATS_ALLAN_LEVELS || stats->allan_n[level] == 0) return -1;
+    return sqrt(stats->allan_sum[level] / (2.0 * stats->allan_n[level]));
+}
+
+// Line fit. Sums are kept about the running means so they stay accurate in
+// 48-bit floating point over thousands of samples.
+void fitReset(LineFit *fit) {
+    memset(fit, 0, sizeof(LineFit));
+}
+
+void fitAdd(LineFit *fit, double x, double y) {
+    double dx, dy;
+    
+    fit->n++;
+    dx = x - fit->mean_x;
+    dy = y - fit->mean_y;
+    fit->mean_x += dx / fit->n;
+    fit->mean_y += dy / fit->n;
+    fit->sxx += dx * (x - fit->mean_x);
+    fit->sxy += dx * (y - fit->mean_y);
+    fit->syy += dy * (y - fit->mean_y);
+}
+
+double fitSlope(LineFit *fit) {
+    return fit->sxy / fit->sxx;
+}
+
+double fitIntercept(LineFit *fit) {
+    return fit->mean_y - fitSlope(fit) * fit->mean_x;
+}
+
+// Standard error of the slope (needs n > 2)
+double fitSlopeError(LineFit *fit) {
+    double residual = fit->syy - fit->sxy * fit->sxy / fit->sxx;
+    
+    if (residual < 0) residual = 0;  // Rounding on a perfect fit
+    return sqrt(residual / (fit->n - 2) / fit->sxx);
+}
+
+// Two-sided 95% Student t value
+double tValue95(unsigned int df) {
+    static double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    
+    if (df == 0) return 0;
+    if (df <= 30) return table[df - 1];
+    return 1.96 + 2.4 / df;  // Within 0.003 of the exact value above 30
+}
+
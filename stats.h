@@ -0,0 +1,47 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Samples kept for the median and Allan deviation windows
+#define STATS_HISTORY       16
+// Median of the last STATS_MEDIAN_WINDOW samples (odd)
+#define STATS_MEDIAN_WINDOW 9
+// Allan deviation at 1, 2, 4 and 8 sample intervals
+#define STATS_ALLAN_LEVELS  4
+
+// Running statistics of a sample stream, updated one sample at a time.
+// Only the last STATS_HISTORY samples are kept.
+typedef struct {
+    unsigned int n;
+    double mean, m2;                            // Welford accumulators
+    double min, max;
+    double history[STATS_HISTORY];              // Ring of recent samples
+    unsigned char head;                         // Next ring slot
+    double allan_sum[STATS_ALLAN_LEVELS];       // Sum of squared differences
+    unsigned int allan_n[STATS_ALLAN_LEVELS];   // Differences summed
+} RunningStats;
+
+// Least-squares line through (x, y) samples, updated one sample at a time
+typedef struct {
+    unsigned int n;
+    double mean_x, mean_y;
+    double sxx, sxy, syy;                       // Centred sums
+} LineFit;
+
+// Running statistics
+void statsReset(RunningStats *stats);
+void statsAdd(RunningStats *stats, double sample);
+double statsStdDev(RunningStats *stats);
+double statsMedian(RunningStats *stats);
+double statsAllan(RunningStats *stats, unsigned char level);
+
+// Line fit
+void fitReset(LineFit *fit);
+void fitAdd(LineFit *fit, double x, double y);
+double fitSlope(LineFit *fit);
+double fitIntercept(LineFit *fit);
+double fitSlopeError(LineFit *fit);
+
+// Two-sided 95% Student t value
+double tValue95(unsigned int df);
+
+#endif // STATS_H
@@ -0,0 +1,65 @@
+#!/bin/sh
+# End-to-end test of the real .COM (make test runs it): calibrates under
+# host/cpmemu at several injected RTC errors and fails unless every RESULT
+# lies within TOL ppm of the injected value. As in tools/hosttest.sh the
+# tolerance is fixed, not the run's own error bar. The emulator's
+# per-cycle T-state lines are passed through.
+#
+#	comtest.sh host/cpmemu rtccalib.com
+#
+# PPMS lists the injected errors, GATE and READINGS the batch /G= and /N=.
+# At the default 60 s gate a reading is good to about 5.5 ppm. Time is
+# emulated, so the runs take as long as the host needs to execute them.
+emu=$1
+com=$2
+PPMS=${PPMS:-"-60 0 25 150"}
+GATE=${GATE:-60}
+READINGS=${READINGS:-5}
+TOL=${TOL:-5}
+
+case $emu in /*) ;; *) emu=$PWD/$emu ;; esac
+case $com in /*) ;; *) com=$PWD/$com ;; esac
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+
+# Calibrate at one error; further arguments go to the emulator
+check() {
+    ppm=$1
+    shift
+    result=$(cd "$dir" && "$emu" -p "$ppm" "$@" "$com" C /G=$GATE /N=$READINGS /Q |
+        tr -d '\r' | grep '^RESULT,')
+    if [ -z "$result" ]; then
+        echo "FAIL $ppm ppm $*: no RESULT line"
+        failed=1
+        return
+    fi
+    # RESULT,ppm,error_ppm,n,s_per_day
+    echo "$result" | awk -F, -v want="$ppm" -v opts="$*" -v tol="$TOL" '{
+        off = $2 - want
+        if (off < 0) off = -off
+        printf "%s %+g ppm%s: measured %s +/- %s ppm (tolerance %s)\n",
+            off <= tol ? "PASS" : "FAIL", want, opts == "" ? "" : " " opts, $2, $3, tol
+        exit off > tol
+    }' || failed=1
+}
+
+for ppm in $PPMS; do
+    check "$ppm"
+done
+
+# Edge jitter, and the B8h status the ROM returns with a valid time
+check 40 -j 200
+check 40 -e B8,7
+
+# An RTC that always fails must give ERROR and return code FF00h
+out=$(cd "$dir" && "$emu" -e 80,1 "$com" C /G=$GATE /N=$READINGS /Q)
+status=$?
+if [ $status -eq 1 ] && echo "$out" | grep -q '^ERROR,'; then
+    echo "PASS failing RTC: ERROR and return code FF00h"
+else
+    echo "FAIL failing RTC: exit status $status"
+    failed=1
+fi
+exit $failed
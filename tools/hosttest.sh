@@ -0,0 +1,51 @@
+#!/bin/sh
+# Host calibration test (make test-host runs it): calibrates the simulated
+# RTC at several injected errors and fails unless every RESULT lies within
+# TOL ppm of the injected value. The tolerance is fixed, not the run's own
+# error bar, so a result that misses by the size of the offsets tested
+# cannot pass.
+#
+#	hosttest.sh ./rtccalib-host
+#
+# PPMS lists the injected errors, GATE and READINGS the batch /G= and /N=.
+# At the default 60 s gate a reading is good to about 5.5 ppm, and the
+# first one, which polls throughout, carries most of the error. The runs
+# go in parallel, each in its own directory, and take about six minutes.
+host=$1
+PPMS=${PPMS:-"-60 0 25 150"}
+GATE=${GATE:-60}
+READINGS=${READINGS:-5}
+TOL=${TOL:-5}
+
+case $host in
+/*) ;;
+*) host=$PWD/$host ;;
+esac
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+for ppm in $PPMS; do
+    mkdir "$dir/$ppm"
+    (cd "$dir/$ppm" && RTCSIM_PPM=$ppm "$host" C /G=$GATE /N=$READINGS /Q |
+        tr -d '\r' | grep '^RESULT,' > result) &
+done
+wait
+
+failed=0
+for ppm in $PPMS; do
+    result=$(cat "$dir/$ppm/result")
+    if [ -z "$result" ]; then
+        echo "FAIL $ppm ppm: no RESULT line"
+        failed=1
+        continue
+    fi
+    # RESULT,ppm,error_ppm,n,s_per_day
+    echo "$result" | awk -F, -v want="$ppm" -v tol="$TOL" '{
+        off = $2 - want
+        if (off < 0) off = -off
+        printf "%s %+g ppm: measured %s +/- %s ppm (tolerance %s)\n",
+            off <= tol ? "PASS" : "FAIL", want, $2, $3, tol
+        exit off > tol
+    }' || failed=1
+done
+exit $failed
@@ -0,0 +1,32 @@
+// Hot paths of the timing loop for z88dk-ticks, built for +test with the
+// same compiler and flags as each rtccalib.com variant (make report).
+// Every path is called once between two marker functions; report.sh
+// counts the T-states from the first marker's address to the second's.
+// The gate's own loop is fixed in rtc.asm; these are the compiled poll
+// routines it calls on every pass, and the I2C byte transfers behind
+// the DS3231 poll.
+#include "../ds1302.h"
+#include "../ds3231.h"
+
+// Byte transfers in ds3231.c
+int i2cWriteByte(unsigned char value);
+unsigned char i2cReadByte(int last);
+
+void hot_ds1302_poll(void) { }
+void hot_ds3231_poll(void) { }
+void hot_i2c_write(void) { }
+void hot_i2c_read(void) { }
+void hot_end(void) { }
+
+int main(void) {
+    hot_ds1302_poll();
+    ds1302_get_seconds();
+    hot_ds3231_poll();
+    ds3231_get_seconds();
+    hot_i2c_write();
+    i2cWriteByte(0x55);
+    hot_i2c_read();
+    i2cReadByte(1);
+    hot_end();
+    return 0;
+}
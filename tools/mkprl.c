@@ -0,0 +1,71 @@
+// Make a page-relocatable (PRL) file, the format of CP/M 3 RSX modules,
+// from one program assembled at origin 0000h and again at 0100h.
+// Bytes that differ by one are the high bytes of addresses; they get a
+// bit in the relocation map that follows the code.
+//
+//	mkprl org0.bin org100.bin out.rsx
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PRL_HEADER 256
+#define PRL_RECORD 128
+#define PRL_MAX    0x8000
+
+static unsigned char code[PRL_MAX], moved[PRL_MAX], map[PRL_MAX / 8];
+
+static long readImage(const char *name, unsigned char *image) {
+    FILE *file = fopen(name, "rb");
+    long size;
+
+    if (!file) {
+        perror(name);
+        exit(1);
+    }
+    size = fread(image, 1, PRL_MAX, file);
+    fclose(file);
+    return size;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned char header[PRL_HEADER];
+    long size, i, total;
+    FILE *out;
+
+    if (argc != 4) {
+        fprintf(stderr, "usage: mkprl org0.bin org100.bin out.rsx\n");
+        return 1;
+    }
+    size = readImage(argv[1], code);
+    if (readImage(argv[2], moved) != size) {
+        fprintf(stderr, "mkprl: the two images differ in length\n");
+        return 1;
+    }
+
+    for (i = 0; i < size; i++) {
+        if (moved[i] == code[i]) continue;
+        if (moved[i] != (unsigned char)(code[i] + 1)) {
+            fprintf(stderr, "mkprl: byte %04lXh is not a relocatable address\n", i);
+            return 1;
+        }
+        map[i / 8] |= 0x80 >> (i % 8);
+    }
+
+    memset(header, 0, sizeof(header));
+    header[1] = size & 0xFF;                // Code length
+    header[2] = size >> 8;
+
+    out = fopen(argv[3], "wb");
+    if (!out) {
+        perror(argv[3]);
+        return 1;
+    }
+    fwrite(header, 1, PRL_HEADER, out);
+    fwrite(code, 1, size, out);
+    fwrite(map, 1, (size + 7) / 8, out);
+    // Pad to whole records with the CP/M end-of-file mark
+    total = PRL_HEADER + size + (size + 7) / 8;
+    for (; total % PRL_RECORD != 0; total++) fputc(0x1A, out);
+    fclose(out);
+    return 0;
+}
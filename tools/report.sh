@@ -0,0 +1,65 @@
+#!/bin/sh
+# Size and cycle report for one build variant (make report runs it for
+# each): .COM size and memory top, the largest functions from the map,
+# and the T-states of the hot paths in hotpath.bin under z88dk-ticks.
+#
+#	report.sh build/<variant> program-name
+dir=$1
+name=$2
+com=$dir/$name.com
+map=$dir/$name.map
+TICKS=${TICKS:-z88dk-ticks}
+
+# z88dk map lines: name = $ADDR ; addr, public, , module, section, file:line
+symbols() {
+    awk -F';' '$1 ~ /= \$/ {
+        split($1, a, "=")
+        name = a[1]; gsub(/ /, "", name)
+        addr = a[2]; gsub(/[ $]/, "", addr)
+        n = split($2, f, ",")
+        for (i = 1; i <= n; i++) gsub(/^ +| +$/, "", f[i])
+        print name, addr, f[1], f[2], f[5]
+    }' "$1"
+}
+
+address() {
+    symbols "$1" | awk -v s="$2" '$1 == s { print $2; exit }'
+}
+
+echo "== ${dir##*/} =="
+if [ ! -f "$com" ]; then
+    echo "  $com not built"
+    exit 1
+fi
+size=$(wc -c < "$com")
+echo "  $name.com: $size bytes, 0100h-$(printf '%04X' $((0x100 + size - 1)))h"
+top=$(address "$map" __tail)
+[ -n "$top" ] && echo "  Memory top with BSS: ${top}h"
+
+echo "  Largest functions (bytes):"
+symbols "$map" |
+    awk '$3 == "addr" && $4 == "public" && $5 ~ /^code/ { print $1, $2 }' |
+    while read sym addr; do echo "$((0x$addr)) $sym"; done |
+    sort -n |
+    awk 'NR > 1 { print $1 - last, name } { last = $1; name = $2 }' |
+    sort -rn | head -${FUNCTIONS:-15} |
+    awk '{ printf "    %6d  %s\n", $1, $2 }'
+
+echo "  Hot paths (T-states per call):"
+if ! command -v "$TICKS" > /dev/null; then
+    echo "    $TICKS not found"
+    exit 0
+fi
+set -- _hot_ds1302_poll ds1302_get_seconds \
+       _hot_ds3231_poll ds3231_get_seconds \
+       _hot_i2c_write i2cWriteByte \
+       _hot_i2c_read i2cReadByte \
+       _hot_end
+while [ $# -gt 2 ]; do
+    start=$(address "$dir/hotpath.map" "$1")
+    end=$(address "$dir/hotpath.map" "$3")
+    ticks=$("$TICKS" -start "$start" -end "$end" -counter 100000000 "$dir/hotpath.bin" |
+            grep -o '[0-9][0-9]*' | tail -1)
+    printf "    %6s  %s\n" "$ticks" "$2"
+    shift 2
+done